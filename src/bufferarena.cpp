@@ -0,0 +1,146 @@
+#include "bufferarena.h"
+
+#include <assert.h>
+#include <stddef.h>
+
+#include <utility>
+
+namespace {
+	GLsizeiptr alignSize(GLsizeiptr size) {
+		const GLsizeiptr alignment = BufferArena::ALIGNMENT;
+		return ((size + alignment - 1) / alignment) * alignment;
+	}
+
+	void createBlock(BufferArena& arena, GLsizeiptr size) {
+		BufferArena::Block block;
+		glCreateBuffers(1, &block.buffer);
+		// the ranges are written with glNamedBufferSubData, at creation and by the updates of dynamic buffers
+		glNamedBufferStorage(block.buffer, size, nullptr, GL_DYNAMIC_STORAGE_BIT);
+		block.size = size;
+		block.freeRanges.push_back({ 0, size });
+		arena.blocks.push_back(std::move(block));
+	}
+
+	// first fit, the front of the free range is taken. the bytes skipped to align the offset stay free
+	bool allocateFromBlock(BufferArena::Block& block, GLsizeiptr size, GLsizeiptr alignment, GLintptr& offset) {
+		for (size_t i = 0; i < block.freeRanges.size(); ++i) {
+			BufferArena::Range& range = block.freeRanges[i];
+			const GLintptr alignedOffset = ((range.offset + alignment - 1) / alignment) * alignment;
+			const GLsizeiptr padding = alignedOffset - range.offset;
+			if (range.size < padding + size) {
+				continue;
+			}
+			offset = alignedOffset;
+			const BufferArena::Range tail = { alignedOffset + size, range.size - padding - size };
+			if (padding > 0) {
+				range.size = padding;
+				if (tail.size > 0) {
+					block.freeRanges.insert(block.freeRanges.begin() + i + 1, tail);
+				}
+			}
+			else if (tail.size > 0) {
+				range = tail;
+			}
+			else {
+				block.freeRanges.erase(block.freeRanges.begin() + i);
+			}
+			return true;
+		}
+		return false;
+	}
+}
+
+void deleteBufferArena(BufferArena& arena) {
+	assert(arena.allocationCount == 0); // buffers still use the arena
+	for (BufferArena::Block& block : arena.blocks) {
+		glDeleteBuffers(1, &block.buffer);
+	}
+	for (const BufferArena::VertexArray& vertexArray : arena.vertexArrays) {
+		glDeleteVertexArrays(1, &vertexArray.vao);
+	}
+	arena.blocks.clear();
+	arena.vertexArrays.clear();
+	arena.bytesInUse = 0;
+}
+
+void allocateFromBufferArena(BufferArena& arena, GLsizeiptr size, const void* pData, BufferRange& range, GLsizeiptr alignment) {
+	assert(range.buffer == 0); // the range is already in use
+	assert(alignment > 0 && alignment % BufferArena::ALIGNMENT == 0);
+	// empty allocations still get a range, vertex arrays need a buffer to bind
+	const GLsizeiptr alignedSize = alignSize(size > 0 ? size : 1);
+
+	unsigned int iBlock = 0;
+	GLintptr offset = 0;
+	while (iBlock < arena.blocks.size() && !allocateFromBlock(arena.blocks[iBlock], alignedSize, alignment, offset)) {
+		++iBlock;
+	}
+	if (iBlock == arena.blocks.size()) {
+		const GLsizeiptr blockSize = alignedSize > BufferArena::BLOCK_SIZE ? alignedSize : BufferArena::BLOCK_SIZE;
+		createBlock(arena, blockSize);
+		allocateFromBlock(arena.blocks.back(), alignedSize, alignment, offset);
+	}
+
+	range.buffer = arena.blocks[iBlock].buffer;
+	range.block = iBlock;
+	range.offset = offset;
+	range.size = alignedSize;
+	arena.bytesInUse += alignedSize;
+	++arena.allocationCount;
+
+	if (pData && size > 0) {
+		glNamedBufferSubData(range.buffer, offset, size, pData);
+	}
+}
+
+void freeToBufferArena(BufferArena& arena, BufferRange& range) {
+	if (!range.buffer) {
+		return;
+	}
+	assert(range.block < arena.blocks.size() && arena.blocks[range.block].buffer == range.buffer);
+	std::vector<BufferArena::Range>& freeRanges = arena.blocks[range.block].freeRanges;
+
+	// insert in offset order and merge with the neighbours
+	size_t i = 0;
+	while (i < freeRanges.size() && freeRanges[i].offset < range.offset) {
+		++i;
+	}
+	const bool mergePrevious = i > 0 && freeRanges[i - 1].offset + freeRanges[i - 1].size == range.offset;
+	const bool mergeNext = i < freeRanges.size() && range.offset + range.size == freeRanges[i].offset;
+	if (mergePrevious && mergeNext) {
+		freeRanges[i - 1].size += range.size + freeRanges[i].size;
+		freeRanges.erase(freeRanges.begin() + i);
+	}
+	else if (mergePrevious) {
+		freeRanges[i - 1].size += range.size;
+	}
+	else if (mergeNext) {
+		freeRanges[i].offset = range.offset;
+		freeRanges[i].size += range.size;
+	}
+	else {
+		freeRanges.insert(freeRanges.begin() + i, { range.offset, range.size });
+	}
+
+	arena.bytesInUse -= range.size;
+	--arena.allocationCount;
+	range = BufferRange();
+}
+
+void getBufferArenaStats(const BufferArena& arena, BufferArenaStats& stats) {
+	stats.blockCount = (unsigned int)arena.blocks.size();
+	stats.allocationCount = arena.allocationCount;
+	stats.capacity = 0;
+	stats.bytesInUse = arena.bytesInUse;
+	stats.freeBytes = 0;
+	stats.largestFreeRange = 0;
+	stats.freeRangeCount = 0;
+	for (const BufferArena::Block& block : arena.blocks) {
+		stats.capacity += block.size;
+		for (const BufferArena::Range& range : block.freeRanges) {
+			stats.freeBytes += range.size;
+			stats.largestFreeRange = range.size > stats.largestFreeRange ? range.size : stats.largestFreeRange;
+		}
+		stats.freeRangeCount += (unsigned int)block.freeRanges.size();
+	}
+	stats.fragmentation = stats.freeBytes > 0 ? 1.f - float(stats.largestFreeRange) / float(stats.freeBytes) : 0.f;
+}
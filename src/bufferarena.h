@@ -0,0 +1,69 @@
+#pragma once
+
+#include <glad.h>
+
+#include <vector>
+
+// vertex or index storage: a range of a BufferArena block, or a whole buffer that is not shared (block unused, offset 0)
+struct BufferRange {
+	GLuint buffer = 0; // 0 when nothing is allocated
+	unsigned int block = 0;
+	GLintptr offset = 0;
+	GLsizeiptr size = 0;
+};
+
+// Vertex and index storage shared by many buffers: a few large immutable GL buffers (blocks) sub-allocated with a first fit free list.
+// The blocks are created on demand and kept once empty. A request larger than BLOCK_SIZE gets a block of its own.
+struct BufferArena {
+	enum : GLsizeiptr {
+		BLOCK_SIZE = 8 * 1024 * 1024,
+		ALIGNMENT = 16, // offset alignment of the allocations, covers the index type and every vertex attribute
+	};
+
+	struct Range {
+		GLintptr offset;
+		GLsizeiptr size;
+	};
+
+	struct Block {
+		GLuint buffer;
+		GLsizeiptr size;
+		std::vector<Range> freeRanges; // sorted by offset, adjacent ranges are merged
+	};
+
+	// vertex array shared by the static buffers of a block that have the same vertex layout and index buffer,
+	// their draws differ by baseVertex and firstIndex only (see createBuffer3D). kept until the arena is deleted
+	struct VertexArray {
+		GLuint vao;
+		unsigned int layoutKey;
+		unsigned int block;
+		GLuint indexBuffer; // 0 for the buffers without indices
+	};
+
+	std::vector<Block> blocks;
+	std::vector<VertexArray> vertexArrays;
+	GLsizeiptr bytesInUse = 0;
+	unsigned int allocationCount = 0;
+};
+
+struct BufferArenaStats {
+	unsigned int blockCount;
+	unsigned int allocationCount;
+	GLsizeiptr capacity; // bytes of every block
+	GLsizeiptr bytesInUse;
+	GLsizeiptr freeBytes;
+	GLsizeiptr largestFreeRange;
+	unsigned int freeRangeCount;
+	float fragmentation; // 1 - largestFreeRange / freeBytes, 0 when the free space is contiguous
+};
+
+void deleteBufferArena(BufferArena& arena);
+
+// size bytes, initialized with pData when not nullptr. the range can be updated with glNamedBufferSubData.
+// alignment is a multiple of ALIGNMENT, not necessarily a power of two: a multiple of the vertex size lets a draw address
+// the vertices with baseVertex
+void allocateFromBufferArena(BufferArena& arena, GLsizeiptr size, const void* pData, BufferRange& range, GLsizeiptr alignment = BufferArena::ALIGNMENT);
+
+void freeToBufferArena(BufferArena& arena, BufferRange& range);
+
+void getBufferArenaStats(const BufferArena& arena, BufferArenaStats& stats);
@@ -40,9 +40,7 @@ struct MyDefaultViewer : Viewer {
 	}
 
 
-	void update(double elapsedTime) override {
-		boneAngle = (float)elapsedTime;
-
+	void beginFrame() override {
 		leftMouseButtonPressed = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
 
 		altKeyPressed = glfwGetKey(window, GLFW_KEY_LEFT_ALT) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_RIGHT_ALT) == GLFW_PRESS;
@@ -57,18 +55,26 @@ struct MyDefaultViewer : Viewer {
 		CustomShaderDataSize = sizeof(VertexShaderAdditionalData);
 	}
 
+	void update(double elapsedTime) override {
+		boneAngle = (float)elapsedTime;
+	}
+
 	void render3D_custom(const RenderApi3D& api) const override {
 		//Here goes your drawcalls affected by the custom vertex shader
 		api.horizontalPlane({ 0, 2, 0 }, { 4, 4 }, 200, glm::vec4(0.0f, 0.2f, 1.f, 1.f));
 	}
 
-	void render3D(const RenderApi3D& api) const override {
+	void renderStatic3D(const RenderApi3D& api) const override {
 		api.horizontalPlane({ 0, 0, 0 }, { 10, 10 }, 1, glm::vec4(0.9f, 0.9f, 0.9f, 1.f));
 
 		api.grid(10.f, 10, glm::vec4(0.5f, 0.5f, 0.5f, 1.f), nullptr);
 
 		api.axisXYZ(nullptr);
 
+		api.solidSphere(glm::vec3(-1.f, 0.5f, 1.f), 0.5f, 100, 100, white);
+	}
+
+	void render3D(const RenderApi3D& api) const override {
 		constexpr float cubeSize = 0.5f;
 		glm::mat4 cubeModelMatrix = glm::translate(glm::identity<glm::mat4>(), cubePosition);
 		api.solidCube(cubeSize, white, &cubeModelMatrix);
@@ -94,8 +100,6 @@ struct MyDefaultViewer : Viewer {
 			glm::vec3 childAbsPos = q * childRelPos;
 			api.solidSphere(childAbsPos, 0.05f, 10, 10, white);
 		}
-
-		api.solidSphere(glm::vec3(-1.f, 0.5f, 1.f), 0.5f, 100, 100, white);
 	}
 
 	void render2D(const RenderApi2D& api) const override {
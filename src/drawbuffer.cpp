@@ -1,116 +1,491 @@
 #include "drawbuffer.h"
 #include <glad.h>
 
+#include <glm/common.hpp>
+#include <glm/exponential.hpp>
+#include <glm/geometric.hpp>
+
+#include <stddef.h>
+#include <utility>
+#include <vector>
+
+namespace {
+	template <typename... Attribs>
+	struct AttribList {};
+
+	// the fp32 arrays the vertices are built from, indexed by attribute location
+	struct VertexSources {
+		void const* arrays[Buffer3D::BufferAttribCount];
+		GLsizei vertexCount;
+		GLsizei capacity; // length of the arrays of a separate layout
+		eVertexLayout layout;
+		eBufferUsage usage;
+		BufferArena* pArena; // nullptr for stream buffers, see CreateBuffer3DParams::pArena
+		// when sharing the vertex array of the arena, see createVertexBuffer
+		unsigned int layoutKey;
+		GLuint indexBuffer;
+	};
+
+	GLsizeiptr greatestCommonDivisor(GLsizeiptr a, GLsizeiptr b) {
+		while (b != 0) {
+			const GLsizeiptr r = a % b;
+			a = b;
+			b = r;
+		}
+		return a;
+	}
+
+	// the vertex array of the arena for the block, layoutKey and indexBuffer. 0 when there is none yet
+	GLuint findSharedVertexArray(const BufferArena& arena, unsigned int layoutKey, unsigned int block, GLuint indexBuffer) {
+		for (const BufferArena::VertexArray& vertexArray : arena.vertexArrays) {
+			if (vertexArray.layoutKey == layoutKey && vertexArray.block == block && vertexArray.indexBuffer == indexBuffer) {
+				return vertexArray.vao;
+			}
+		}
+		return 0;
+	}
+
+	// a range of the arena when there is one, else a buffer of its own.
+	// stream buffers keep a mutable storage so that they can be orphaned
+	BufferRange createVertexStorage(BufferArena* pArena, GLsizeiptr size, const void* pData, eBufferUsage usage, GLsizeiptr alignment = BufferArena::ALIGNMENT) {
+		BufferRange storage;
+		if (pArena) {
+			assert(usage != eBufferUsage::Stream);
+			allocateFromBufferArena(*pArena, size, pData, storage, alignment);
+			return storage;
+		}
+		glCreateBuffers(1, &storage.buffer);
+		if (usage == eBufferUsage::Stream) {
+			glNamedBufferData(storage.buffer, size, pData, GL_STREAM_DRAW);
+		}
+		else if (size > 0) {
+			glNamedBufferStorage(storage.buffer, size, pData, usage == eBufferUsage::Dynamic ? GL_DYNAMIC_STORAGE_BIT : 0);
+		}
+		storage.size = size;
+		return storage;
+	}
+
+	void deleteStorage(BufferArena* pArena, BufferRange& storage) {
+		if (pArena) {
+			freeToBufferArena(*pArena, storage);
+			return;
+		}
+		glDeleteBuffers(1, &storage.buffer);
+		storage = BufferRange();
+	}
+
+	template <typename Layout, GLuint I>
+	void writeAttrib(void* pVertices, const VertexSources& sources, GLsizei iVertex) {
+		using Attrib = typename Layout::template Attrib<I>;
+		using Source = typename Attrib::Source;
+		const Source* pSource = static_cast<const Source*>(sources.arrays[Attrib::location]);
+		Layout::template write<I>(pVertices, sources.capacity, iVertex, Attrib::pack(pSource[iVertex]));
+	}
+
+	// packs the vertices in the layout, uploads them in one storage range and declares the layout on vao.
+	// a vao of 0 takes the vertex array the arena shares for the block of the storage (created on first use): the vertices are
+	// then interleaved at a multiple of the vertex size, the draws address them with baseVertex
+	template <typename Layout, GLuint... I>
+	BufferRange createVertexBuffer(GLuint& vao, const VertexSources& sources, std::integer_sequence<GLuint, I...>) {
+		std::vector<char> vertices(Layout::bufferSize(sources.capacity));
+		for (GLsizei iVertex = 0; iVertex < sources.vertexCount; ++iVertex) {
+			const int expand[] = { (writeAttrib<Layout, I>(vertices.data(), sources, iVertex), 0)... };
+			(void)expand;
+		}
+
+		if (vao) {
+			const BufferRange storage = createVertexStorage(sources.pArena, vertices.size(), vertices.data(), sources.usage);
+			Layout::setupFormat(vao);
+			Layout::bindBuffer(vao, storage.buffer, storage.offset, sources.capacity);
+			return storage;
+		}
+
+		static_assert(Layout::vertexSize > 0, "empty vertex layout");
+		assert(sources.pArena && sources.layout == eVertexLayout::Interleaved);
+		const GLsizeiptr arenaAlignment = BufferArena::ALIGNMENT;
+		const GLsizeiptr alignment = arenaAlignment / greatestCommonDivisor(arenaAlignment, Layout::vertexSize) * Layout::vertexSize;
+		const BufferRange storage = createVertexStorage(sources.pArena, vertices.size(), vertices.data(), sources.usage, alignment);
+		vao = findSharedVertexArray(*sources.pArena, sources.layoutKey, storage.block, sources.indexBuffer);
+		if (!vao) {
+			glCreateVertexArrays(1, &vao);
+			Layout::setupFormat(vao);
+			Layout::bindBuffer(vao, storage.buffer, 0, sources.capacity);
+			if (sources.indexBuffer) {
+				glVertexArrayElementBuffer(vao, sources.indexBuffer);
+			}
+			setupInstanceAttributes(vao);
+			sources.pArena->vertexArrays.push_back({ vao, sources.layoutKey, storage.block, sources.indexBuffer });
+		}
+		return storage;
+	}
+
+	// the formats are runtime parameters, each step below appends the attribute matching the requested format
+	template <typename... Attribs>
+	BufferRange createVertices(GLuint& vao, const VertexSources& sources, AttribList<Attribs...>) {
+		using Indices = std::make_integer_sequence<GLuint, sizeof...(Attribs)>;
+		if (sources.layout == eVertexLayout::Separate) {
+			return createVertexBuffer<VertexLayout<eVertexLayout::Separate, Attribs...>>(vao, sources, Indices());
+		}
+		return createVertexBuffer<VertexLayout<eVertexLayout::Interleaved, Attribs...>>(vao, sources, Indices());
+	}
+
+	// without color stream the attribute array stays disabled, the draw uses the generic value (see glVertexAttrib4f)
+	template <GLuint ColorLocation, typename... Attribs>
+	BufferRange createVerticesWithColor(GLuint& vao, const VertexSources& sources, eColorFormat format, AttribList<Attribs...>) {
+		if (!sources.arrays[ColorLocation] || format == eColorFormat::Uniform) {
+			return createVertices(vao, sources, AttribList<Attribs...>());
+		}
+		if (format == eColorFormat::UNorm8) {
+			return createVertices(vao, sources, AttribList<Attribs..., AttribColor4ub<ColorLocation>>());
+		}
+		return createVertices(vao, sources, AttribList<Attribs..., AttribColor4f<ColorLocation>>());
+	}
+
+	template <typename... Attribs>
+	BufferRange createVerticesWithNormal(GLuint& vao, const VertexSources& sources, const CreateBuffer3DParams& params, AttribList<Attribs...>) {
+		if (!params.pNormals) {
+			return createVerticesWithColor<Buffer3D::BufferAttribColor>(vao, sources, params.colorFormat, AttribList<Attribs...>());
+		}
+		if (params.normalFormat == eNormalFormat::Int2_10_10_10) {
+			return createVerticesWithColor<Buffer3D::BufferAttribColor>(vao, sources, params.colorFormat, AttribList<Attribs..., AttribNormal2_10_10_10>());
+		}
+		return createVerticesWithColor<Buffer3D::BufferAttribColor>(vao, sources, params.colorFormat, AttribList<Attribs..., AttribNormal3f>());
+	}
+
+	// the formats and attributes of the layout, the buffers sharing a vertex array must have the same
+	unsigned int getLayoutKey(const Buffer3D& buffer) {
+		const unsigned int normalKey = buffer.hasNormals ? 1 + (unsigned int)buffer.normalFormat : 0;
+		const unsigned int colorKey = buffer.hasColors ? 1 + (unsigned int)buffer.colorFormat : 0;
+		return (unsigned int)buffer.positionFormat | normalKey << 1 | colorKey << 3;
+	}
+
+	BufferRange createVertices3D(GLuint& vao, const CreateBuffer3DParams& params, BufferArena* pArena, unsigned int layoutKey, GLuint indexBuffer) {
+		VertexSources sources;
+		sources.arrays[Buffer3D::BufferAttribVertex] = params.pVertices;
+		sources.arrays[Buffer3D::BufferAttribNormal] = params.pNormals;
+		sources.arrays[Buffer3D::BufferAttribColor] = params.pColors;
+		sources.vertexCount = params.vertexCount;
+		sources.capacity = params.vertexCount;
+		sources.layout = params.usage == eBufferUsage::Static ? params.vertexLayout : eVertexLayout::Separate;
+		sources.usage = params.usage;
+		sources.pArena = pArena;
+		sources.layoutKey = layoutKey;
+		sources.indexBuffer = indexBuffer;
+		if (params.positionFormat == ePositionFormat::Float16) {
+			return createVerticesWithNormal(vao, sources, params, AttribList<AttribPosition3h>());
+		}
+		return createVerticesWithNormal(vao, sources, params, AttribList<AttribPosition3f>());
+	}
+
+	BufferRange createVertices2D(GLuint& vao, const CreateBuffer2DParams& params, BufferArena* pArena) {
+		static_assert(int(Buffer2D::BufferAttribCount) <= int(Buffer3D::BufferAttribCount), "VertexSources is indexed by location");
+		VertexSources sources = {};
+		sources.arrays[Buffer2D::BufferAttribVertex] = params.pVertices;
+		sources.arrays[Buffer2D::BufferAttribColor] = params.pColors;
+		sources.vertexCount = params.vertexCount;
+		sources.capacity = params.vertexCount;
+		sources.layout = params.usage == eBufferUsage::Static ? params.vertexLayout : eVertexLayout::Separate;
+		sources.usage = params.usage;
+		sources.pArena = pArena;
+		return createVerticesWithColor<Buffer2D::BufferAttribColor>(vao, sources, params.colorFormat, AttribList<AttribPosition2f>());
+	}
+
+	// bytes per vertex of each attribute, 0 when the buffer does not have it.
+	// the order is the one of the layout, see createVertices3D and createVertices2D
+	void getAttribSizes(const Buffer3D& buffer, GLsizei sizes[Buffer3D::BufferAttribCount]) {
+		sizes[Buffer3D::BufferAttribVertex] = buffer.positionFormat == ePositionFormat::Float16 ? sizeof(AttribPosition3h::Storage) : sizeof(AttribPosition3f::Storage);
+		sizes[Buffer3D::BufferAttribNormal] = !buffer.hasNormals ? 0
+			: buffer.normalFormat == eNormalFormat::Int2_10_10_10 ? sizeof(AttribNormal2_10_10_10::Storage) : sizeof(AttribNormal3f::Storage);
+		sizes[Buffer3D::BufferAttribColor] = !buffer.hasColors ? 0
+			: buffer.colorFormat == eColorFormat::UNorm8 ? sizeof(glm::uint32) : sizeof(glm::vec4);
+	}
+
+	void getAttribSizes(const Buffer2D& buffer, GLsizei sizes[Buffer2D::BufferAttribCount]) {
+		sizes[Buffer2D::BufferAttribVertex] = sizeof(AttribPosition2f::Storage);
+		sizes[Buffer2D::BufferAttribColor] = !buffer.hasColors ? 0
+			: buffer.colorFormat == eColorFormat::UNorm8 ? sizeof(glm::uint32) : sizeof(glm::vec4);
+	}
+
+	template <typename Attrib>
+	const void* packArray(const void* pData, GLsizei count, std::vector<char>& packed) {
+		packed.resize(count * sizeof(typename Attrib::Storage));
+		typename Attrib::Source const* pSource = static_cast<typename Attrib::Source const*>(pData);
+		typename Attrib::Storage* pPacked = reinterpret_cast<typename Attrib::Storage*>(packed.data());
+		for (GLsizei i = 0; i < count; ++i) {
+			pPacked[i] = Attrib::pack(pSource[i]);
+		}
+		return packed.data();
+	}
+
+	// returns the values in the stored format, pData itself when that is the fp32 source format
+	const void* packAttrib(const Buffer3D& buffer, unsigned int attrib, const void* pData, GLsizei count, std::vector<char>& packed) {
+		if (attrib == Buffer3D::BufferAttribVertex && buffer.positionFormat == ePositionFormat::Float16) {
+			return packArray<AttribPosition3h>(pData, count, packed);
+		}
+		if (attrib == Buffer3D::BufferAttribNormal && buffer.normalFormat == eNormalFormat::Int2_10_10_10) {
+			return packArray<AttribNormal2_10_10_10>(pData, count, packed);
+		}
+		if (attrib == Buffer3D::BufferAttribColor && buffer.colorFormat == eColorFormat::UNorm8) {
+			return packArray<AttribColor4ub<Buffer3D::BufferAttribColor>>(pData, count, packed);
+		}
+		return pData;
+	}
+
+	const void* packAttrib(const Buffer2D& buffer, unsigned int attrib, const void* pData, GLsizei count, std::vector<char>& packed) {
+		if (attrib == Buffer2D::BufferAttribColor && buffer.colorFormat == eColorFormat::UNorm8) {
+			return packArray<AttribColor4ub<Buffer2D::BufferAttribColor>>(pData, count, packed);
+		}
+		return pData;
+	}
+
+	// the arrays of a separate layout follow each other, each one is capacity elements long
+	template <typename Buffer>
+	void reserveVertices(Buffer& buffer, GLsizei capacity) {
+		assert(buffer.usage != eBufferUsage::Static); // static buffers are immutable, only they share a vertex array
+		if (capacity <= buffer.capacity) {
+			return;
+		}
+
+		GLsizei sizes[Buffer::BufferAttribCount];
+		getAttribSizes(buffer, sizes);
+		GLsizei vertexSize = 0;
+		for (GLsizei size : sizes) {
+			vertexSize += size;
+		}
+
+		BufferRange storage = createVertexStorage(buffer.pArena, GLsizeiptr(capacity) * vertexSize, nullptr, buffer.usage);
+		GLintptr arrayOffset = 0;
+		GLuint binding = 0;
+		for (GLuint attrib = 0; attrib < Buffer::BufferAttribCount; ++attrib) {
+			if (!sizes[attrib]) {
+				continue;
+			}
+			if (buffer.vertexCount > 0) {
+				glCopyNamedBufferSubData(buffer.vertexStorage.buffer, storage.buffer, buffer.vertexStorage.offset + buffer.capacity * arrayOffset,
+					storage.offset + capacity * arrayOffset, GLsizeiptr(buffer.vertexCount) * sizes[attrib]);
+			}
+			glVertexArrayVertexBuffer(buffer.vao, binding++, storage.buffer, storage.offset + capacity * arrayOffset, sizes[attrib]);
+			arrayOffset += sizes[attrib];
+		}
+
+		deleteStorage(buffer.pArena, buffer.vertexStorage);
+		buffer.vertexStorage = storage;
+		buffer.capacity = capacity;
+	}
+
+	template <typename Buffer>
+	void resizeVertices(Buffer& buffer, GLsizei vertexCount) {
+		if (vertexCount > buffer.capacity) {
+			reserveVertices(buffer, glm::max(vertexCount, 2 * buffer.capacity));
+		}
+		buffer.vertexCount = vertexCount;
+	}
+
+	bool hasTranslucentColor(glm::vec4 const* pColors, GLsizei count) {
+		for (GLsizei i = 0; i < count; ++i) {
+			if (pColors[i].a < 1.f) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// moves and enlarges the sphere just enough to hold each position outside of it
+	void growBoundingSphere(glm::vec4& bounds, glm::vec3 const* pPositions, GLsizei count) {
+		glm::vec3 center = glm::vec3(bounds);
+		float radius = bounds.w;
+		for (GLsizei i = 0; i < count; ++i) {
+			const float distance = glm::distance(center, pPositions[i]);
+			if (distance > radius) {
+				const float newRadius = 0.5f * (radius + distance);
+				center += (distance - newRadius) / distance * (pPositions[i] - center);
+				radius = newRadius;
+			}
+		}
+		bounds = glm::vec4(center, radius);
+	}
+
+	template <typename Buffer>
+	void updateVertices(Buffer& buffer, unsigned int attrib, GLsizei offset, GLsizei count, const void* pData) {
+		assert(buffer.usage != eBufferUsage::Static); // static buffers are immutable
+		assert(attrib < Buffer::BufferAttribCount);
+		if (count <= 0) {
+			return;
+		}
+
+		GLsizei sizes[Buffer::BufferAttribCount];
+		getAttribSizes(buffer, sizes);
+		assert(sizes[attrib] != 0); // the buffer was created without this attribute
+
+		if (offset + count > buffer.vertexCount) {
+			resizeVertices(buffer, offset + count);
+		}
+
+		GLsizeiptr vertexSize = 0;
+		GLintptr arrayOffset = 0;
+		for (GLuint i = 0; i < Buffer::BufferAttribCount; ++i) {
+			arrayOffset += i < attrib ? sizes[i] : 0;
+			vertexSize += sizes[i];
+		}
+		const GLintptr rangeOffset = buffer.vertexStorage.offset + buffer.capacity * arrayOffset + GLintptr(offset) * sizes[attrib];
+		const GLsizeiptr rangeSize = GLsizeiptr(count) * sizes[attrib];
+
+		std::vector<char> packed;
+		const void* pPacked = packAttrib(buffer, attrib, pData, count, packed);
+
+		if (buffer.usage == eBufferUsage::Stream) {
+			// the GPU may still read the previous values, give the driver a fresh range instead of waiting
+			if (rangeSize == buffer.capacity * vertexSize) {
+				glNamedBufferData(buffer.vertexStorage.buffer, rangeSize, nullptr, GL_STREAM_DRAW);
+			}
+			else {
+				glInvalidateBufferSubData(buffer.vertexStorage.buffer, rangeOffset, rangeSize);
+			}
+		}
+		glNamedBufferSubData(buffer.vertexStorage.buffer, rangeOffset, rangeSize, pPacked);
+	}
+}
+
 void createBuffer3D(Buffer3D& buffer, const CreateBuffer3DParams& params) {
 	assert(buffer.vao == 0); // trying to create a buffer already initialized
 
-	glGenVertexArrays(1, &buffer.vao);
-
-	glBindVertexArray(buffer.vao);
-
-	// Bind vertices and upload data
-	assert(buffer.vbos[Buffer3D::BufferAttribVertex] == 0); // trying to create a buffer already initialized
-	glGenBuffers(1, &buffer.vbos[Buffer3D::BufferAttribVertex]);
-	glBindBuffer(GL_ARRAY_BUFFER, buffer.vbos[Buffer3D::BufferAttribVertex]);
-	glEnableVertexAttribArray(0);
-	{
-		constexpr size_t size = sizeof(*params.pVertices) / sizeof((*params.pVertices)[0]);
-		constexpr size_t stride = sizeof(*params.pVertices);
-		glVertexAttribPointer(0, size, GL_FLOAT, GL_FALSE, stride, (void*)0);
-	}
-	glBufferData(GL_ARRAY_BUFFER, params.vertexCount * sizeof(*params.pVertices), params.pVertices, GL_STATIC_DRAW);
-
-	assert(buffer.vbos[Buffer3D::BufferAttribNormal] == 0); // trying to create a buffer already initialized
-	if(params.pNormals) {
-		glGenBuffers(1, &buffer.vbos[Buffer3D::BufferAttribNormal]);
-		// Bind normals and upload data
-		glBindBuffer(GL_ARRAY_BUFFER, buffer.vbos[buffer.BufferAttribNormal]);
-		glEnableVertexAttribArray(1);
-		{
-			constexpr size_t size = sizeof(*params.pNormals) / sizeof((*params.pNormals)[0]);
-			constexpr size_t stride = sizeof(*params.pNormals);
-			glVertexAttribPointer(1, size, GL_FLOAT, GL_FALSE, stride, (void*)0);
-		}
-		glBufferData(GL_ARRAY_BUFFER, params.vertexCount * sizeof(*params.pNormals), params.pNormals, GL_STATIC_DRAW);
-	} else {
-		buffer.vbos[Buffer3D::BufferAttribNormal] = 0;
-	}
-
-	// Bind colors and upload data
-	assert(buffer.vbos[Buffer3D::BufferAttribColor] == 0); // trying to create a buffer already initialized
-	glGenBuffers(1, &buffer.vbos[Buffer3D::BufferAttribColor]);
-	glBindBuffer(GL_ARRAY_BUFFER, buffer.vbos[buffer.BufferAttribColor]);
-	glEnableVertexAttribArray(2);
-	{
-		constexpr size_t size = sizeof(*params.pColors) / sizeof((*params.pColors)[0]);
-		constexpr size_t stride = sizeof(*params.pColors);
-		glVertexAttribPointer(2, size, GL_FLOAT, GL_FALSE, stride, (void*)0);
-	}
-	glBufferData(GL_ARRAY_BUFFER, params.vertexCount * sizeof(*params.pColors), params.pColors, GL_STATIC_DRAW);
-
-	if(params.pIndices) {
-		glGenBuffers(1, &buffer.ibo);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer.ibo);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(*params.pIndices) * params.indexCount, params.pIndices, GL_STATIC_DRAW);
-	} else {
-		buffer.ibo = 0;
+	buffer.pArena = params.usage != eBufferUsage::Stream ? params.pArena : nullptr;
+	buffer.hasNormals = params.pNormals != nullptr;
+	buffer.hasColors = params.pColors != nullptr && params.colorFormat != eColorFormat::Uniform;
+	buffer.hasTranslucentColors = buffer.hasColors && hasTranslucentColor(params.pColors, params.vertexCount);
+	buffer.uniformColor = params.uniformColor;
+	buffer.bounds = computeBoundingSphere(params.pVertices, params.vertexCount);
+	buffer.usage = params.usage;
+	buffer.capacity = params.vertexCount;
+	buffer.positionFormat = params.positionFormat;
+	buffer.normalFormat = params.normalFormat;
+	buffer.colorFormat = params.colorFormat;
+
+	if (params.pIndices) {
+		const GLsizeiptr size = sizeof(*params.pIndices) * params.indexCount;
+		if (buffer.pArena) {
+			allocateFromBufferArena(*buffer.pArena, size, params.pIndices, buffer.indexStorage);
+		}
+		else {
+			glCreateBuffers(1, &buffer.indexStorage.buffer);
+			glNamedBufferStorage(buffer.indexStorage.buffer, size, params.pIndices, 0);
+			buffer.indexStorage.size = size;
+		}
+		buffer.indexCount = params.indexCount;
+	}
+	else {
+		buffer.indexStorage = BufferRange();
 		buffer.indexCount = 0;
 	}
-
+	buffer.firstIndex = GLuint(buffer.indexStorage.offset / sizeof(unsigned int));
 	buffer.vertexCount = params.vertexCount;
-	buffer.indexCount = params.indexCount;
 
-	// Unbind everything. Potentially illegal on some implementations
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-}
+	buffer.sharedVertexArray = buffer.pArena && params.usage == eBufferUsage::Static && params.vertexLayout == eVertexLayout::Interleaved;
+	if (buffer.sharedVertexArray) {
+		buffer.vertexStorage = createVertices3D(buffer.vao, params, buffer.pArena, getLayoutKey(buffer), buffer.indexStorage.buffer);
+		GLsizei sizes[Buffer3D::BufferAttribCount];
+		getAttribSizes(buffer, sizes);
+		const GLsizei vertexSize = sizes[Buffer3D::BufferAttribVertex] + sizes[Buffer3D::BufferAttribNormal] + sizes[Buffer3D::BufferAttribColor];
+		buffer.baseVertex = GLint(buffer.vertexStorage.offset / vertexSize);
+		return;
+	}
 
-void deleteBuffer3D(Buffer3D& buffer) {
-	glDeleteBuffers(buffer.BufferAttribCount, buffer.vbos);
-	glDeleteBuffers(1, &buffer.ibo);
-	glDeleteVertexArrays(1, &buffer.vao);
-	memset(buffer.vbos, 0, sizeof(buffer.vbos));
-	buffer.vao = 0;
+	glCreateVertexArrays(1, &buffer.vao);
+	buffer.vertexStorage = createVertices3D(buffer.vao, params, buffer.pArena, 0, 0);
+	buffer.baseVertex = 0;
+	if (buffer.indexStorage.buffer) {
+		glVertexArrayElementBuffer(buffer.vao, buffer.indexStorage.buffer);
+	}
+	setupInstanceAttributes(buffer.vao);
 }
 
-void createBuffer2D(Buffer2D& buffer, const CreateBuffer2DParams& params) {
-	glGenVertexArrays(1, &buffer.vao);
-	glGenBuffers(buffer.BufferAttribCount, buffer.vbos);
+glm::vec4 computeBoundingSphere(glm::vec3 const* pPositions, GLsizei count) {
+	if (count <= 0) {
+		return glm::vec4(0.f);
+	}
+	// center of the box, then the farthest position
+	glm::vec3 boxMin = pPositions[0];
+	glm::vec3 boxMax = pPositions[0];
+	for (GLsizei i = 1; i < count; ++i) {
+		boxMin = glm::min(boxMin, pPositions[i]);
+		boxMax = glm::max(boxMax, pPositions[i]);
+	}
+	const glm::vec3 center = 0.5f * (boxMin + boxMax);
+	float radius2 = 0.f;
+	for (GLsizei i = 0; i < count; ++i) {
+		const glm::vec3 offset = pPositions[i] - center;
+		radius2 = glm::max(radius2, glm::dot(offset, offset));
+	}
+	return glm::vec4(center, glm::sqrt(radius2));
+}
 
-	glBindVertexArray(buffer.vao);
+void setupInstanceAttributes(GLuint vao) {
+	for (GLuint iColumn = 0; iColumn < 4; ++iColumn) {
+		const GLuint location = InstanceAttribModel + iColumn;
+		glEnableVertexArrayAttrib(vao, location);
+		glVertexArrayAttribFormat(vao, location, 4, GL_FLOAT, GL_FALSE, offsetof(InstanceData3D, model) + iColumn * sizeof(glm::vec4));
+		glVertexArrayAttribBinding(vao, location, InstanceBufferBinding);
+	}
+	glEnableVertexArrayAttrib(vao, InstanceAttribColor);
+	glVertexArrayAttribFormat(vao, InstanceAttribColor, 4, GL_FLOAT, GL_FALSE, offsetof(InstanceData3D, color));
+	glVertexArrayAttribBinding(vao, InstanceAttribColor, InstanceBufferBinding);
+	glEnableVertexArrayAttrib(vao, InstanceAttribParams);
+	glVertexArrayAttribIFormat(vao, InstanceAttribParams, 4, GL_INT, offsetof(InstanceData3D, params));
+	glVertexArrayAttribBinding(vao, InstanceAttribParams, InstanceBufferBinding);
+	glVertexArrayBindingDivisor(vao, InstanceBufferBinding, 1);
+}
 
-	// Bind vertices and upload data
-	glBindBuffer(GL_ARRAY_BUFFER, buffer.vbos[buffer.BufferAttribVertex]);
-	glEnableVertexAttribArray(0);
-	{
-		constexpr size_t size = sizeof(*params.pVertices) / sizeof((*params.pVertices)[0]);
-		constexpr size_t stride = sizeof(*params.pVertices);
-		glVertexAttribPointer(0, size, GL_FLOAT, GL_FALSE, stride, (void*)0);
+void deleteBuffer3D(Buffer3D& buffer) {
+	deleteStorage(buffer.pArena, buffer.vertexStorage);
+	deleteStorage(buffer.pArena, buffer.indexStorage);
+	// a shared vertex array belongs to the arena
+	if (!buffer.sharedVertexArray) {
+		glDeleteVertexArrays(1, &buffer.vao);
 	}
-	glBufferData(GL_ARRAY_BUFFER, params.vertexCount * sizeof(*params.pVertices), params.pVertices, GL_STATIC_DRAW);
+	buffer.vao = 0;
+	buffer.sharedVertexArray = false;
+	buffer.pArena = nullptr;
+}
 
-	// Bind colors and upload data
-	glBindBuffer(GL_ARRAY_BUFFER, buffer.vbos[buffer.BufferAttribColor]);
-	glEnableVertexAttribArray(1);
-	{
-		constexpr size_t size = sizeof(*params.pColors) / sizeof((*params.pColors)[0]);
-		constexpr size_t stride = sizeof(*params.pColors);
-		glVertexAttribPointer(1, size, GL_FLOAT, GL_FALSE, stride, (void*)0);
+void updateBuffer3D(Buffer3D& buffer, unsigned int attrib, GLsizei offset, GLsizei count, const void* pData) {
+	updateVertices(buffer, attrib, offset, count, pData);
+	if (attrib == Buffer3D::BufferAttribVertex) {
+		growBoundingSphere(buffer.bounds, static_cast<glm::vec3 const*>(pData), count);
+	}
+	else if (attrib == Buffer3D::BufferAttribColor) {
+		buffer.hasTranslucentColors |= hasTranslucentColor(static_cast<glm::vec4 const*>(pData), count);
 	}
-	glBufferData(GL_ARRAY_BUFFER, params.vertexCount * sizeof(*params.pColors), params.pColors, GL_STATIC_DRAW);
+}
 
-	buffer.vertexCount = params.vertexCount;
+void resizeBuffer3D(Buffer3D& buffer, GLsizei vertexCount) {
+	resizeVertices(buffer, vertexCount);
+}
 
-	// Unbind everything. Potentially illegal on some implementations
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+void createBuffer2D(Buffer2D& buffer, const CreateBuffer2DParams& params) {
+	assert(buffer.vao == 0); // trying to create a buffer already initialized
+
+	glCreateVertexArrays(1, &buffer.vao);
+	buffer.pArena = params.usage != eBufferUsage::Stream ? params.pArena : nullptr;
+	buffer.vertexStorage = createVertices2D(buffer.vao, params, buffer.pArena);
+	buffer.hasColors = params.pColors != nullptr && params.colorFormat != eColorFormat::Uniform;
+	buffer.uniformColor = params.uniformColor;
+	buffer.vertexCount = params.vertexCount;
+	buffer.usage = params.usage;
+	buffer.capacity = params.vertexCount;
+	buffer.colorFormat = params.colorFormat;
 }
 
 void deleteBuffer2D(Buffer2D& buffer) {
-	glDeleteBuffers(buffer.BufferAttribCount, buffer.vbos);
+	deleteStorage(buffer.pArena, buffer.vertexStorage);
 	glDeleteVertexArrays(1, &buffer.vao);
-	memset(buffer.vbos, 0, sizeof(buffer.vbos));
 	buffer.vao = 0;
+	buffer.pArena = nullptr;
+}
+
+void updateBuffer2D(Buffer2D& buffer, unsigned int attrib, GLsizei offset, GLsizei count, const void* pData) {
+	updateVertices(buffer, attrib, offset, count, pData);
+}
+
+void resizeBuffer2D(Buffer2D& buffer, GLsizei vertexCount) {
+	resizeVertices(buffer, vertexCount);
 }
@@ -3,8 +3,39 @@
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
 #include <glad.h>
 
+#include "vertexlayout.h"
+#include "bufferarena.h"
+
+#include <glm/packing.hpp>
+#include <glm/gtc/packing.hpp>
+
+// opt-in compact vertex layouts, the fp32 formats are the default
+enum class ePositionFormat {
+	Float32, // 12 bytes
+	Float16, // 8 bytes, fine for unit meshes and small scenes
+};
+
+enum class eNormalFormat {
+	Float32, // 12 bytes
+	Int2_10_10_10, // 4 bytes, GL_INT_2_10_10_10_REV
+};
+
+enum class eColorFormat {
+	Float32, // 16 bytes
+	UNorm8, // 4 bytes, normalized RGBA8
+	Uniform, // no color stream, every vertex uses uniformColor
+};
+
+// how often the vertices change after creation
+enum class eBufferUsage {
+	Static, // immutable storage, never updated
+	Dynamic, // updated now and then with glNamedBufferSubData
+	Stream, // rewritten every frame, the updated range is orphaned before the upload
+};
+
 struct Buffer3D {
 	enum {
 		BufferAttribVertex = 0,
@@ -12,26 +43,85 @@ struct Buffer3D {
 		BufferAttribColor,
 		BufferAttribCount
 	};
+	// static interleaved buffers of an arena share the vertex array of their block and layout (see BufferArena::VertexArray),
+	// the draws of a block can then be merged. the other buffers have a vertex array of their own, bound at their storage
 	GLuint vao = 0;
-	GLuint vbos[BufferAttribCount] = {};
-	GLuint ibo = 0;
+	bool sharedVertexArray = false;
+	GLint baseVertex = 0; // of the first vertex in vao, 0 with a vertex array of its own
+	GLuint firstIndex = 0; // of the first index in the element buffer of vao
+	BufferRange vertexStorage; // every attribute of the vertices, see CreateBuffer3DParams::vertexLayout
+	BufferRange indexStorage; // buffer 0 without indices
+	BufferArena* pArena = nullptr; // owner of the storage ranges, nullptr when the buffer owns its GL buffers
 	GLsizei vertexCount = 0;
 	GLsizei indexCount = 0;
+	bool hasNormals = false;
+	bool hasColors = false;
+	bool hasTranslucentColors = false; // a vertex color has alpha < 1, the draws of the buffer are blended
+	glm::vec4 uniformColor = glm::vec4(1.f); // color of the vertices when the buffer has no color stream
+	glm::vec4 bounds = glm::vec4(0.f); // bounding sphere of the positions (center, radius), only grows with the updates
+
+	// needed by the updates, see updateBuffer3D
+	eBufferUsage usage = eBufferUsage::Static;
+	GLsizei capacity = 0; // vertices the storage can hold, grows by doubling
+	ePositionFormat positionFormat = ePositionFormat::Float32;
+	eNormalFormat normalFormat = eNormalFormat::Float32;
+	eColorFormat colorFormat = eColorFormat::Float32;
 };
 
 struct CreateBuffer3DParams {
 	glm::vec3 const* pVertices = nullptr;
 	glm::vec3 const* pNormals = nullptr;
-	glm::vec4 const* pColors = nullptr;
+	glm::vec4 const* pColors = nullptr; // nullptr behaves as eColorFormat::Uniform
 	unsigned int const* pIndices = nullptr;
 	GLsizei vertexCount = 0;
 	GLsizei indexCount = 0;
+
+	// layout of the GPU copy, the source arrays above are always fp32
+	ePositionFormat positionFormat = ePositionFormat::Float32;
+	eNormalFormat normalFormat = eNormalFormat::Float32;
+	eColorFormat colorFormat = eColorFormat::Float32;
+	glm::vec4 uniformColor = glm::vec4(1.f);
+	eVertexLayout vertexLayout = eVertexLayout::Interleaved;
+	// dynamic and stream buffers are always stored as separate arrays, an attribute update is then one contiguous range
+	eBufferUsage usage = eBufferUsage::Static;
+	// vertices and indices are sub-allocated from the arena (see RenderEngine::bufferArena), nullptr creates buffers of their own.
+	// stream buffers ignore it, orphaning needs a buffer of their own
+	BufferArena* pArena = nullptr;
 };
 
 void createBuffer3D(Buffer3D& buffer, const CreateBuffer3DParams& params);
 
+// a sphere (center, radius) holding every position, not the smallest one
+glm::vec4 computeBoundingSphere(glm::vec3 const* pPositions, GLsizei count);
+
+// not while a draw of the buffer is recorded: the 3D draws read their buffers at the end of the pass (see RenderApi3D::buffer)
 void deleteBuffer3D(Buffer3D& buffer);
 
+// Writes count values of the attribute from vertex offset, pData has the fp32 source type of CreateBuffer3DParams (glm::vec3 for positions and normals, glm::vec4 for colors).
+// Only for dynamic and stream buffers. When offset + count is past vertexCount the buffer grows, the other attributes of the new vertices are undefined until written.
+// Draws already recorded during the pass use the updated vertices.
+void updateBuffer3D(Buffer3D& buffer, unsigned int attrib /*Buffer3D::BufferAttrib...*/, GLsizei offset, GLsizei count, const void* pData);
+
+// changes vertexCount, the storage is reallocated (doubling) only when the capacity is exceeded
+void resizeBuffer3D(Buffer3D& buffer, GLsizei vertexCount);
+
+// per instance attributes, every 3D draw is instanced (see shader_3d.vert)
+enum {
+	InstanceAttribModel = Buffer3D::BufferAttribCount, // mat4, uses 4 consecutive locations
+	InstanceAttribColor = InstanceAttribModel + 4,
+	InstanceAttribParams = InstanceAttribColor + 1, // ivec4
+	InstanceBufferBinding = InstanceAttribModel, // vertex buffer binding index of the instance data
+};
+
+struct InstanceData3D {
+	glm::mat4 model;
+	glm::vec4 color; // multiplied by the vertex color
+	glm::ivec4 params; // eProceduralShape and its two parameters (None for regular meshes), w unused (lighting is a permutation of the program)
+};
+
+// declares the per instance attributes on vao, the instance buffer is bound to InstanceBufferBinding at draw time
+void setupInstanceAttributes(GLuint vao);
+
 struct Buffer2D {
 	enum {
 		BufferAttribVertex = 0,
@@ -39,16 +129,73 @@ struct Buffer2D {
 		BufferAttribCount
 	};
 	GLuint vao = 0;
-	GLuint vbos[BufferAttribCount] = {};
+	BufferRange vertexStorage;
+	BufferArena* pArena = nullptr;
 	GLsizei vertexCount = 0;
+	bool hasColors = false;
+	glm::vec4 uniformColor = glm::vec4(1.f); // color of the vertices when the buffer has no color stream
+
+	eBufferUsage usage = eBufferUsage::Static;
+	GLsizei capacity = 0;
+	eColorFormat colorFormat = eColorFormat::Float32;
 };
 
 struct CreateBuffer2DParams {
 	glm::vec2 const* pVertices = nullptr;
-	glm::vec4 const* pColors = nullptr;
+	glm::vec4 const* pColors = nullptr; // nullptr behaves as eColorFormat::Uniform
 	GLsizei vertexCount = 0;
+
+	eColorFormat colorFormat = eColorFormat::Float32;
+	glm::vec4 uniformColor = glm::vec4(1.f);
+	eVertexLayout vertexLayout = eVertexLayout::Interleaved;
+	eBufferUsage usage = eBufferUsage::Static; // see CreateBuffer3DParams::usage
+	BufferArena* pArena = nullptr; // see CreateBuffer3DParams::pArena
 };
 
 void createBuffer2D(Buffer2D& buffer, const CreateBuffer2DParams& params);
 
 void deleteBuffer2D(Buffer2D& buffer);
+
+// same as updateBuffer3D, glm::vec2 positions and glm::vec4 colors
+void updateBuffer2D(Buffer2D& buffer, unsigned int attrib /*Buffer2D::BufferAttrib...*/, GLsizei offset, GLsizei count, const void* pData);
+
+void resizeBuffer2D(Buffer2D& buffer, GLsizei vertexCount);
+
+// vertex attributes of the buffers, pack converts the fp32 source value to the stored one
+struct AttribPosition3f : VertexAttrib<Buffer3D::BufferAttribVertex, glm::vec3, 3, GL_FLOAT> {
+	using Source = glm::vec3;
+	static glm::vec3 pack(const glm::vec3& position) { return position; }
+};
+
+// 4 halves keep each vertex 4 bytes aligned, w is ignored by the 3 components attribute
+struct AttribPosition3h : VertexAttrib<Buffer3D::BufferAttribVertex, glm::uint64, 3, GL_HALF_FLOAT> {
+	using Source = glm::vec3;
+	static glm::uint64 pack(const glm::vec3& position) { return glm::packHalf4x16(glm::vec4(position, 1.f)); }
+};
+
+struct AttribPosition2f : VertexAttrib<Buffer2D::BufferAttribVertex, glm::vec2, 2, GL_FLOAT> {
+	using Source = glm::vec2;
+	static glm::vec2 pack(const glm::vec2& position) { return position; }
+};
+
+struct AttribNormal3f : VertexAttrib<Buffer3D::BufferAttribNormal, glm::vec3, 3, GL_FLOAT> {
+	using Source = glm::vec3;
+	static glm::vec3 pack(const glm::vec3& normal) { return normal; }
+};
+
+struct AttribNormal2_10_10_10 : VertexAttrib<Buffer3D::BufferAttribNormal, glm::uint32, 4, GL_INT_2_10_10_10_REV, GL_TRUE> {
+	using Source = glm::vec3;
+	static glm::uint32 pack(const glm::vec3& normal) { return glm::packSnorm3x10_1x2(glm::vec4(normal, 0.f)); }
+};
+
+template <GLuint Location>
+struct AttribColor4f : VertexAttrib<Location, glm::vec4, 4, GL_FLOAT> {
+	using Source = glm::vec4;
+	static glm::vec4 pack(const glm::vec4& color) { return color; }
+};
+
+template <GLuint Location>
+struct AttribColor4ub : VertexAttrib<Location, glm::uint32, 4, GL_UNSIGNED_BYTE, GL_TRUE> {
+	using Source = glm::vec4;
+	static glm::uint32 pack(const glm::vec4& color) { return glm::packUnorm4x8(color); }
+};
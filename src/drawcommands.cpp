@@ -0,0 +1,329 @@
+#include "drawcommands.h"
+#include "renderengine.h"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <assert.h>
+#include <float.h>
+#include <string.h>
+
+namespace {
+	// layouts defined by the GL specification for glMultiDraw*Indirect
+	struct DrawElementsIndirectCommand {
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+
+	struct DrawArraysIndirectCommand {
+		GLuint count;
+		GLuint instanceCount;
+		GLuint first;
+		GLuint baseInstance;
+	};
+
+	// both kinds of records share the same slot size so that a single allocation serves the whole list
+	constexpr GLsizei INDIRECT_COMMAND_STRIDE = sizeof(DrawElementsIndirectCommand);
+
+	// opaque keys: draw mode, vertex array, program and indexed above the depth. the state stays the first criterion so that
+	// the runs merged in one multi draw are as long as possible, the draws of a run are then ordered front to back.
+	// coplanar draws depend on this order: the mode comes first (it is not GL state) so that points and lines lying on a surface,
+	// such as a grid on a plane, are drawn before it and win the depth test, and the vertex array comes before the program, whose
+	// names depend on the order the permutations are first used in
+	// translucent keys only have the depth, reversed, equal depths keep the submission order (stable sort)
+	constexpr unsigned long long TRANSLUCENT_KEY_BIT = 1ull << 63;
+	constexpr unsigned long long DEPTH_KEY_MAX = 0xFFFF; // the depth takes the low 16 bits
+
+	unsigned long long computeSortKey(const DrawCommand3D& command) {
+		if (command.translucent) {
+			return TRANSLUCENT_KEY_BIT;
+		}
+		unsigned long long key = 0;
+		key |= (unsigned long long)(command.drawMode & 0xF) << 59;
+		key |= (unsigned long long)(command.vao & 0xFFFF) << 43;
+		key |= (unsigned long long)(command.pShader->programId & 0xFF) << 35;
+		key |= (unsigned long long)command.indexed << 34;
+		return key;
+	}
+
+	// quantizes the view depth of the bounding spheres in the low bits of the keys, one pass to get the range then one to write.
+	// an opaque draw is ordered by the nearest point of its sphere, a translucent one by its center
+	void addDepthToSortKeys(DrawCommandList3D& list) {
+		std::vector<DrawCommand3D>& commands = list.commands;
+		std::vector<float>& depths = list.depths;
+		depths.resize(commands.size());
+
+		float minDepth = FLT_MAX;
+		float maxDepth = -FLT_MAX;
+		for (size_t i = 0; i < commands.size(); ++i) {
+			const glm::vec4& bounds = commands[i].bounds;
+			const float depth = glm::dot(list.depthPlane, glm::vec4(bounds.x, bounds.y, bounds.z, 1.f)) - (commands[i].translucent ? 0.f : bounds.w);
+			depths[i] = depth;
+			minDepth = glm::min(minDepth, depth);
+			maxDepth = glm::max(maxDepth, depth);
+		}
+
+		const float scale = maxDepth > minDepth ? DEPTH_KEY_MAX / (maxDepth - minDepth) : 0.f;
+		for (size_t i = 0; i < commands.size(); ++i) {
+			DrawCommand3D& command = commands[i];
+			const unsigned long long depthKey = (unsigned long long)((depths[i] - minDepth) * scale);
+			command.sortKey = (command.sortKey & ~DEPTH_KEY_MAX) | (command.translucent ? DEPTH_KEY_MAX - depthKey : depthKey);
+		}
+	}
+
+	bool canMerge(const DrawCommand3D& a, const DrawCommand3D& b) {
+		return a.pShader == b.pShader
+			&& a.vao == b.vao
+			&& a.drawMode == b.drawMode
+			&& a.indexed == b.indexed
+			&& a.translucent == b.translucent;
+	}
+
+	void sortCommands(std::vector<DrawCommand3D>& commands) {
+		std::stable_sort(commands.begin(), commands.end(), [](const DrawCommand3D& a, const DrawCommand3D& b) {
+			return a.sortKey < b.sortKey;
+		});
+	}
+
+	// end of the run of commands that can be merged with commands[iFirst]
+	size_t findRunEnd(const std::vector<DrawCommand3D>& commands, size_t iFirst) {
+		size_t iEnd = iFirst + 1;
+		while (iEnd < commands.size() && canMerge(commands[iFirst], commands[iEnd])) {
+			++iEnd;
+		}
+		return iEnd;
+	}
+
+	void writeIndirectRecords(DrawCommand3D const* commands, size_t count, char* pRecords) {
+		for (size_t i = 0; i < count; ++i, pRecords += INDIRECT_COMMAND_STRIDE) {
+			const DrawCommand3D& command = commands[i];
+			if (command.indexed) {
+				*reinterpret_cast<DrawElementsIndirectCommand*>(pRecords) = { command.count, command.instanceCount, command.first, command.baseVertex, command.baseInstance };
+			}
+			else {
+				*reinterpret_cast<DrawArraysIndirectCommand*>(pRecords) = { command.count, command.instanceCount, command.first, command.baseInstance };
+			}
+		}
+	}
+
+	void multiDrawIndirect(GLenum drawMode, bool indexed, GLintptr indirectOffset, GLsizei drawCount) {
+		if (indexed) {
+			glMultiDrawElementsIndirect(drawMode, GL_UNSIGNED_INT, (void*)indirectOffset, drawCount, INDIRECT_COMMAND_STRIDE);
+		}
+		else {
+			glMultiDrawArraysIndirect(drawMode, (void*)indirectOffset, drawCount, INDIRECT_COMMAND_STRIDE);
+		}
+	}
+
+	// dataBuffer holds the instances, and the vertices/indices of transientVao3D
+	void bindCommandVertexArray(RenderEngine& engine, GLuint vao, GLuint dataBuffer) {
+		glVertexArrayVertexBuffer(vao, InstanceBufferBinding, dataBuffer, 0, sizeof(InstanceData3D));
+		if (vao == engine.transientVao3D) {
+			glVertexArrayVertexBuffer(vao, 0, dataBuffer, 0, sizeof(TransientVertex3D));
+			glVertexArrayElementBuffer(vao, dataBuffer);
+		}
+		setVertexArray(engine.glState, vao);
+	}
+
+	void setGenericAttributes() {
+		// vertex arrays without color stream use the generic value, the instance color does the rest
+		glVertexAttrib4f(Buffer3D::BufferAttribColor, 1.f, 1.f, 1.f, 1.f);
+	}
+
+	void drawCommand(const DrawCommand3D& command) {
+		if (command.indexed) {
+			glDrawElementsInstancedBaseVertexBaseInstance(command.drawMode, command.count, GL_UNSIGNED_INT,
+				(void*)(GLintptr(command.first) * sizeof(GLuint)), command.instanceCount, command.baseVertex, command.baseInstance);
+		}
+		else {
+			glDrawArraysInstancedBaseInstance(command.drawMode, command.first, command.count, command.instanceCount, command.baseInstance);
+		}
+	}
+}
+
+void recordDrawCommand3D(DrawCommandList3D& list, DrawCommand3D command) {
+	command.sortKey = computeSortKey(command);
+	list.commands.push_back(command);
+	++list.recordedCount;
+}
+
+void flushDrawCommands3D(RenderEngine& engine) {
+	DrawCommandList3D& list = engine.drawCommands3D;
+	std::vector<DrawCommand3D>& commands = list.commands;
+	if (commands.empty()) {
+		return;
+	}
+
+	addDepthToSortKeys(list);
+	sortCommands(commands);
+
+	// the indirect records go in the transient buffer too, when the region is full fall back to one draw per command
+	// (the region cannot be recycled here, the recorded commands still read from it)
+	const GLsizeiptr indirectSize = commands.size() * INDIRECT_COMMAND_STRIDE;
+	char* pIndirect = nullptr;
+	GLintptr indirectOffset = 0;
+	if (transientBufferHasRoom(engine.transientBuffer, indirectSize, sizeof(GLuint))) {
+		pIndirect = (char*)allocateEngineTransient(engine, indirectSize, sizeof(GLuint), indirectOffset);
+		setDrawIndirectBuffer(engine.glState, engine.transientBuffer.buffer);
+	}
+
+	setGenericAttributes();
+
+	const size_t commandCount = commands.size();
+	size_t iFirst = 0;
+	while (iFirst < commandCount) {
+		const DrawCommand3D& first = commands[iFirst];
+		const size_t iEnd = findRunEnd(commands, iFirst);
+
+		setProgram(engine.glState, first.pShader->programId);
+		setBlendEnabled(engine.glState, first.translucent);
+		// the transient buffer can be reallocated when it grows, always bind the current one
+		bindCommandVertexArray(engine, first.vao, engine.transientBuffer.buffer);
+
+		if (pIndirect) {
+			writeIndirectRecords(&commands[iFirst], iEnd - iFirst, pIndirect + iFirst * INDIRECT_COMMAND_STRIDE);
+			multiDrawIndirect(first.drawMode, first.indexed, indirectOffset + iFirst * INDIRECT_COMMAND_STRIDE, GLsizei(iEnd - iFirst));
+		}
+		else {
+			for (size_t i = iFirst; i < iEnd; ++i) {
+				drawCommand(commands[i]);
+			}
+		}
+
+		++list.batchCount;
+		iFirst = iEnd;
+	}
+
+	commands.clear();
+}
+
+void buildStaticBatch3D(RenderEngine& engine, GLintptr dataOffset, GLsizeiptr dataSize) {
+	static_assert(StaticBatch3D::DATA_ALIGNMENT % sizeof(InstanceData3D) == 0
+		&& StaticBatch3D::DATA_ALIGNMENT % sizeof(TransientVertex3D) == 0, "rebased offsets must stay whole elements");
+	assert(dataOffset % StaticBatch3D::DATA_ALIGNMENT == 0);
+
+	StaticBatch3D& batch = engine.staticBatch3D;
+	assert(!batch.captured);
+	std::vector<DrawCommand3D>& commands = engine.drawCommands3D.commands;
+
+	// the data moves to the start of its own buffer, rebase what points into the transient buffer
+	for (DrawCommand3D& command : commands) {
+		command.baseInstance -= GLuint(dataOffset / sizeof(InstanceData3D));
+		if (command.vao == engine.transientVao3D) {
+			if (command.indexed) {
+				command.first -= GLuint(dataOffset / sizeof(GLuint));
+				command.baseVertex -= GLint(dataOffset / sizeof(TransientVertex3D));
+			}
+			else {
+				command.first -= GLuint(dataOffset / sizeof(TransientVertex3D));
+			}
+		}
+	}
+	sortCommands(commands);
+
+	if (dataSize > 0) {
+		glCreateBuffers(1, &batch.dataBuffer);
+		glNamedBufferStorage(batch.dataBuffer, dataSize, nullptr, 0);
+		glCopyNamedBufferSubData(engine.transientBuffer.buffer, batch.dataBuffer, dataOffset, 0, dataSize);
+	}
+
+	std::vector<char> records(commands.size() * INDIRECT_COMMAND_STRIDE);
+	if (!commands.empty()) {
+		writeIndirectRecords(commands.data(), commands.size(), records.data());
+		glCreateBuffers(1, &batch.indirectBuffer);
+		glNamedBufferStorage(batch.indirectBuffer, records.size(), records.data(), 0);
+	}
+
+	batch.runs.clear();
+	size_t iFirst = 0;
+	while (iFirst < commands.size()) {
+		const DrawCommand3D& first = commands[iFirst];
+		const size_t iEnd = findRunEnd(commands, iFirst);
+
+		StaticDrawRun3D run;
+		run.pShader = first.pShader;
+		run.vao = first.vao;
+		run.drawMode = first.drawMode;
+		run.indexed = first.indexed;
+		run.translucent = first.translucent;
+		run.indirectOffset = iFirst * INDIRECT_COMMAND_STRIDE;
+		run.drawCount = GLsizei(iEnd - iFirst);
+		batch.runs.push_back(run);
+
+		iFirst = iEnd;
+	}
+
+	batch.commandCount = (unsigned int)commands.size();
+	batch.captured = true;
+	commands.clear();
+}
+
+void deleteStaticBatch3D(StaticBatch3D& batch) {
+	if (batch.dataBuffer) {
+		glDeleteBuffers(1, &batch.dataBuffer);
+	}
+	if (batch.indirectBuffer) {
+		glDeleteBuffers(1, &batch.indirectBuffer);
+	}
+	batch.dataBuffer = 0;
+	batch.indirectBuffer = 0;
+	batch.runs.clear();
+	batch.commandCount = 0;
+	batch.captured = false;
+}
+
+void drawStaticBatch3D(RenderEngine& engine) {
+	const StaticBatch3D& batch = engine.staticBatch3D;
+	if (batch.runs.empty()) {
+		return;
+	}
+
+	setDrawIndirectBuffer(engine.glState, batch.indirectBuffer);
+	setGenericAttributes();
+
+	for (const StaticDrawRun3D& run : batch.runs) {
+		setProgram(engine.glState, run.pShader->programId);
+		setBlendEnabled(engine.glState, run.translucent);
+		bindCommandVertexArray(engine, run.vao, batch.dataBuffer);
+		multiDrawIndirect(run.drawMode, run.indexed, run.indirectOffset, run.drawCount);
+		++engine.drawCommands3D.batchCount;
+	}
+}
+
+void flushDrawBatch2D(RenderEngine& engine) {
+	DrawBatch2D& batch = engine.drawBatch2D;
+	const GLsizei triangleVertexCount = GLsizei(batch.triangles.size());
+	const GLsizei lineVertexCount = GLsizei(batch.lines.size());
+	if (triangleVertexCount + lineVertexCount == 0) {
+		return;
+	}
+
+	GLintptr offset;
+	TransientVertex2D* vertices = (TransientVertex2D*)allocateEngineTransient(engine, (triangleVertexCount + lineVertexCount) * sizeof(TransientVertex2D), sizeof(TransientVertex2D), offset);
+	if (!vertices) {
+		batch.triangles.clear();
+		batch.lines.clear();
+		return;
+	}
+	memcpy(vertices, batch.triangles.data(), triangleVertexCount * sizeof(TransientVertex2D));
+	memcpy(vertices + triangleVertexCount, batch.lines.data(), lineVertexCount * sizeof(TransientVertex2D));
+	const GLint firstVertex = GLint(offset / sizeof(TransientVertex2D));
+
+	// the vertex buffer is bound at draw time, the transient buffer can be reallocated when it grows
+	glVertexArrayVertexBuffer(engine.transientVao2D, 0, engine.transientBuffer.buffer, 0, sizeof(TransientVertex2D));
+	setVertexArray(engine.glState, engine.transientVao2D);
+	if (triangleVertexCount) {
+		glDrawArrays(GL_TRIANGLES, firstVertex, triangleVertexCount);
+	}
+	if (lineVertexCount) {
+		glDrawArrays(GL_LINES, firstVertex + triangleVertexCount, lineVertexCount);
+	}
+
+	// clear keeps the capacity, the next frame does not reallocate
+	batch.triangles.clear();
+	batch.lines.clear();
+}
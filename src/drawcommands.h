@@ -0,0 +1,82 @@
+#pragma once
+
+#include <glad.h>
+
+#include <glm/vec4.hpp>
+
+#include <vector>
+
+struct RenderEngine;
+struct ShaderProgram3D;
+
+// One recorded RenderApi3D draw. Every 3D draw is instanced, the model matrix, the color and the params
+// of each instance are already written in the transient buffer (see InstanceData3D).
+struct DrawCommand3D {
+	unsigned long long sortKey;
+	ShaderProgram3D const* pShader;
+	GLuint vao;
+	GLenum drawMode;
+	GLuint count; // index count for indexed draws, vertex count otherwise
+	GLuint first; // first index for indexed draws, first vertex otherwise
+	GLint baseVertex;
+	GLuint instanceCount;
+	GLuint baseInstance;
+	bool indexed;
+	bool translucent; // drawn last, back to front and blended. opaque draws go front to back without blending
+	glm::vec4 bounds; // world space bounding sphere of every instance (center, radius), orders the draws by depth
+};
+
+struct DrawCommandList3D {
+	std::vector<DrawCommand3D> commands;
+	std::vector<float> depths; // scratch of flushDrawCommands3D, keeps its capacity
+
+	// view depth of a world position p is dot(depthPlane, vec4(p, 1)), set at the start of the frame
+	glm::vec4 depthPlane;
+
+	// per frame stats
+	unsigned int recordedCount;
+	unsigned int batchCount;
+};
+
+// a run of compatible static commands, drawn with one multi draw indirect
+struct StaticDrawRun3D {
+	ShaderProgram3D const* pShader;
+	GLuint vao;
+	GLenum drawMode;
+	bool indexed;
+	bool translucent;
+	GLintptr indirectOffset; // in indirectBuffer
+	GLsizei drawCount;
+};
+
+// 3D content recorded once and replayed every frame with a constant number of GL calls.
+// the instances, vertices and indices written in the transient buffer during the capture are copied to dataBuffer
+struct StaticBatch3D {
+	// lcm of the instance and transient vertex strides, the captured data starts on such a boundary so that it can be rebased
+	enum { DATA_ALIGNMENT = 96 };
+
+	GLuint dataBuffer;
+	GLuint indirectBuffer;
+	std::vector<StaticDrawRun3D> runs;
+	unsigned int commandCount;
+	bool captured;
+};
+
+// computes the sort key and appends the command
+void recordDrawCommand3D(DrawCommandList3D& list, DrawCommand3D command);
+
+// sorts the recorded commands by draw mode, vertex array and program, then by depth: front to back for the opaque draws,
+// back to front for the translucent ones that go last. then submits each run of compatible commands with one multi draw indirect
+void flushDrawCommands3D(RenderEngine& engine);
+
+// uploads the staged 2D vertices at once, then draws the triangles and the lines (lines end up on top)
+void flushDrawBatch2D(RenderEngine& engine);
+
+// turns the recorded commands into the static batch of the engine.
+// their data occupies [dataOffset, dataOffset + dataSize) of the transient buffer, dataOffset is a multiple of StaticBatch3D::DATA_ALIGNMENT
+void buildStaticBatch3D(RenderEngine& engine, GLintptr dataOffset, GLsizeiptr dataSize);
+
+void deleteStaticBatch3D(StaticBatch3D& batch);
+
+// one multi draw indirect per run, whatever the amount of static content
+void drawStaticBatch3D(RenderEngine& engine);
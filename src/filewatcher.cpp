@@ -0,0 +1,94 @@
+#include "filewatcher.h"
+
+#include <stdio.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+bool createFileWatcher(FileWatcher& watcher, const char* directory) {
+	HANDLE handle = FindFirstChangeNotificationA(directory, FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+	if (handle == INVALID_HANDLE_VALUE) {
+		fprintf(stderr, "Failed to watch %s\n", directory);
+		return false;
+	}
+	watcher.changeHandle = handle;
+	return true;
+}
+
+void deleteFileWatcher(FileWatcher& watcher) {
+	if (watcher.changeHandle) {
+		FindCloseChangeNotification(watcher.changeHandle);
+	}
+	watcher = FileWatcher();
+}
+
+bool pollFileWatcher(FileWatcher& watcher) {
+	bool changed = false;
+	while (watcher.changeHandle && WaitForSingleObject(watcher.changeHandle, 0) == WAIT_OBJECT_0) {
+		changed = true;
+		if (!FindNextChangeNotification(watcher.changeHandle)) {
+			break;
+		}
+	}
+	return changed;
+}
+
+#elif defined(__linux__)
+
+bool createFileWatcher(FileWatcher& watcher, const char* directory) {
+	const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	// editors either write the file in place or write a new one and rename it over the old one
+	if (fd < 0 || inotify_add_watch(fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE) < 0) {
+		fprintf(stderr, "Failed to watch %s\n", directory);
+		if (fd >= 0) {
+			close(fd);
+		}
+		return false;
+	}
+	watcher.inotifyFd = fd;
+	return true;
+}
+
+void deleteFileWatcher(FileWatcher& watcher) {
+	if (watcher.inotifyFd >= 0) {
+		close(watcher.inotifyFd);
+	}
+	watcher = FileWatcher();
+}
+
+bool pollFileWatcher(FileWatcher& watcher) {
+	// the events only say that something changed, the programs compare their sources to know what
+	alignas(inotify_event) char events[4096];
+	bool changed = false;
+	while (watcher.inotifyFd >= 0 && read(watcher.inotifyFd, events, sizeof(events)) > 0) {
+		changed = true;
+	}
+	return changed;
+}
+
+#else
+
+bool createFileWatcher(FileWatcher& watcher, const char* directory) {
+	(void)watcher;
+	(void)directory;
+	return false;
+}
+
+void deleteFileWatcher(FileWatcher& watcher) {
+	(void)watcher;
+}
+
+bool pollFileWatcher(FileWatcher& watcher) {
+	(void)watcher;
+	return false;
+}
+
+#endif
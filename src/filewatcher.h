@@ -0,0 +1,20 @@
+#pragma once
+
+// Changes to the files of a directory (not its subdirectories), reported without blocking: inotify on linux,
+// a change notification on windows. Not supported elsewhere, the watcher then never reports anything
+struct FileWatcher {
+#if defined(_WIN32)
+	void* changeHandle = nullptr;
+#elif defined(__linux__)
+	int inotifyFd = -1;
+#endif
+};
+
+// false when the directory cannot be watched
+bool createFileWatcher(FileWatcher& watcher, const char* directory);
+
+void deleteFileWatcher(FileWatcher& watcher);
+
+// true when a file was written, created, renamed or deleted since the previous call (an editor saving a file often does
+// several of these, they are reported together when they happen between two calls)
+bool pollFileWatcher(FileWatcher& watcher);
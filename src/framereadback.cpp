@@ -0,0 +1,78 @@
+#include "framereadback.h"
+
+#include <assert.h>
+
+namespace {
+	constexpr GLsizeiptr BYTES_PER_PIXEL = 4;
+
+	// true when the copy of the slot was delivered, or the slot was free
+	bool deliverSlot(FrameReadback& readback, unsigned int slot, bool wait, FrameReadbackCallback* callback, void* pUserData) {
+		GLsync& fence = readback.fences[slot];
+		if (!fence) {
+			return true;
+		}
+		const GLuint64 timeout = wait ? GL_TIMEOUT_IGNORED : 0;
+		const GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+		if (status == GL_TIMEOUT_EXPIRED) {
+			return false;
+		}
+		assert(status != GL_WAIT_FAILED);
+		glDeleteSync(fence);
+		fence = nullptr;
+
+		const GLsizeiptr size = readback.width * readback.height * BYTES_PER_PIXEL;
+		const void* pPixels = glMapNamedBufferRange(readback.buffers[slot], 0, size, GL_MAP_READ_BIT);
+		if (pPixels) {
+			callback(readback.frameIndices[slot], static_cast<const unsigned char*>(pPixels), readback.width, readback.height, pUserData);
+			glUnmapNamedBuffer(readback.buffers[slot]);
+		}
+		return true;
+	}
+}
+
+void createFrameReadback(FrameReadback& readback, GLsizei width, GLsizei height) {
+	assert(readback.buffers[0] == 0); // trying to create a frame readback already initialized
+	readback.width = width;
+	readback.height = height;
+	glCreateBuffers(FrameReadback::RING_SIZE, readback.buffers);
+	for (GLuint buffer : readback.buffers) {
+		glNamedBufferStorage(buffer, width * height * BYTES_PER_PIXEL, nullptr, GL_MAP_READ_BIT);
+	}
+}
+
+void deleteFrameReadback(FrameReadback& readback) {
+	for (GLsync fence : readback.fences) {
+		glDeleteSync(fence);
+	}
+	glDeleteBuffers(FrameReadback::RING_SIZE, readback.buffers);
+	readback = FrameReadback();
+}
+
+void queueFrameReadback(FrameReadback& readback, GLuint fbo, unsigned int frameIndex, FrameReadbackCallback* callback, void* pUserData) {
+	collectFrameReadbacks(readback, false, callback, pUserData);
+
+	// ring full: the oldest copy has to be waited for
+	const unsigned int slot = readback.nextSlot;
+	deliverSlot(readback, slot, true, callback, pUserData);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+	glNamedFramebufferReadBuffer(fbo, fbo ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffers[slot]);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, readback.width, readback.height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	readback.fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	readback.frameIndices[slot] = frameIndex;
+	readback.nextSlot = (slot + 1) % FrameReadback::RING_SIZE;
+}
+
+void collectFrameReadbacks(FrameReadback& readback, bool wait, FrameReadbackCallback* callback, void* pUserData) {
+	// from the oldest pending copy, stops at the first one not completed to keep the frame order
+	for (unsigned int i = 0; i < FrameReadback::RING_SIZE; ++i) {
+		const unsigned int slot = (readback.nextSlot + i) % FrameReadback::RING_SIZE;
+		if (!deliverSlot(readback, slot, wait, callback, pUserData)) {
+			return;
+		}
+	}
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <glad.h>
+
+// pPixels: RGBA8, width * height, bottom row first. only valid during the call
+using FrameReadbackCallback = void(unsigned int frameIndex, const unsigned char* pPixels, GLsizei width, GLsizei height, void* pUserData);
+
+// Copies of rendered frames to the CPU that do not stall the pipeline: glReadPixels goes to a pixel pack buffer of a ring
+// and returns at once, the buffer is mapped later, when the fence queued after the copy is signaled.
+// Only waits when all the buffers of the ring hold copies the GPU has not finished yet
+struct FrameReadback {
+	enum { RING_SIZE = 3 };
+
+	GLuint buffers[RING_SIZE] = {};
+	GLsync fences[RING_SIZE] = {}; // nullptr for a free slot
+	unsigned int frameIndices[RING_SIZE] = {};
+	unsigned int nextSlot = 0; // the oldest pending copy when the slot is not free
+	GLsizei width = 0;
+	GLsizei height = 0;
+};
+
+void createFrameReadback(FrameReadback& readback, GLsizei width, GLsizei height);
+
+// pending copies are dropped
+void deleteFrameReadback(FrameReadback& readback);
+
+// queues the copy of the width x height color attachment 0 of fbo, delivers the completed copies first
+void queueFrameReadback(FrameReadback& readback, GLuint fbo, unsigned int frameIndex, FrameReadbackCallback* callback, void* pUserData);
+
+// delivers the completed copies in frame order, every pending one with wait (end of a run)
+void collectFrameReadbacks(FrameReadback& readback, bool wait, FrameReadbackCallback* callback, void* pUserData);
@@ -0,0 +1,99 @@
+#include "glstate.h"
+
+namespace {
+	// updates the cached value and returns true when the GL call is needed
+	template <typename T>
+	bool changeState(GLStateCache& cache, T& cached, T value) {
+		if (cached == value) {
+			++cache.elidedCount;
+			return false;
+		}
+		cached = value;
+		++cache.callCount;
+		return true;
+	}
+
+	void setCapability(GLStateCache& cache, GLint& cached, GLenum capability, bool enabled) {
+		if (changeState(cache, cached, GLint(enabled))) {
+			if (enabled) {
+				glEnable(capability);
+			}
+			else {
+				glDisable(capability);
+			}
+		}
+	}
+}
+
+void invalidateGLStateCache(GLStateCache& cache) {
+	const unsigned int callCount = cache.callCount;
+	const unsigned int elidedCount = cache.elidedCount;
+	cache = GLStateCache();
+	cache.callCount = callCount;
+	cache.elidedCount = elidedCount;
+}
+
+void invalidateGLStateObjects(GLStateCache& cache) {
+	cache.program = GLStateCache::UNKNOWN;
+	cache.vao = GLStateCache::UNKNOWN;
+	cache.drawIndirectBuffer = GLStateCache::UNKNOWN;
+}
+
+void beginGLStateCacheFrame(GLStateCache& cache) {
+	invalidateGLStateObjects(cache);
+	cache.callCount = 0;
+	cache.elidedCount = 0;
+}
+
+void setProgram(GLStateCache& cache, GLuint program) {
+	if (changeState(cache, cache.program, program)) {
+		glUseProgram(program);
+	}
+}
+
+void setVertexArray(GLStateCache& cache, GLuint vao) {
+	if (changeState(cache, cache.vao, vao)) {
+		glBindVertexArray(vao);
+	}
+}
+
+void setDrawIndirectBuffer(GLStateCache& cache, GLuint buffer) {
+	if (changeState(cache, cache.drawIndirectBuffer, buffer)) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer);
+	}
+}
+
+void setBlendEnabled(GLStateCache& cache, bool enabled) {
+	setCapability(cache, cache.blendEnabled, GL_BLEND, enabled);
+}
+
+void setBlendFuncSeparate(GLStateCache& cache, GLenum srcRGB, GLenum dstRGB, GLenum srcAlpha, GLenum dstAlpha) {
+	const bool changed = cache.blendSrcRGB != srcRGB || cache.blendDstRGB != dstRGB
+		|| cache.blendSrcAlpha != srcAlpha || cache.blendDstAlpha != dstAlpha;
+	if (!changed) {
+		++cache.elidedCount;
+		return;
+	}
+	cache.blendSrcRGB = srcRGB;
+	cache.blendDstRGB = dstRGB;
+	cache.blendSrcAlpha = srcAlpha;
+	cache.blendDstAlpha = dstAlpha;
+	++cache.callCount;
+	glBlendFuncSeparate(srcRGB, dstRGB, srcAlpha, dstAlpha);
+}
+
+void setDepthTestEnabled(GLStateCache& cache, bool enabled) {
+	setCapability(cache, cache.depthTestEnabled, GL_DEPTH_TEST, enabled);
+}
+
+void setPointSize(GLStateCache& cache, GLfloat size) {
+	if (changeState(cache, cache.pointSize, size)) {
+		glPointSize(size);
+	}
+}
+
+void setLineWidth(GLStateCache& cache, GLfloat width) {
+	if (changeState(cache, cache.lineWidth, width)) {
+		glLineWidth(width);
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <glad.h>
+
+// CPU copy of the GL state changed by the engine, the calls that would not change anything are skipped.
+// The state is never read back from GL: code outside the engine that changes it must call invalidateGLStateCache.
+// (the ImGui backend restores what it changes, it does not need to)
+struct GLStateCache {
+	enum : unsigned int { UNKNOWN = ~0u };
+
+	// objects, forgotten at the start of each frame since a deleted name can be reused
+	GLuint program = UNKNOWN;
+	GLuint vao = UNKNOWN;
+	GLuint drawIndirectBuffer = UNKNOWN;
+
+	// fixed function state, kept from one frame to the next
+	GLint blendEnabled = -1; // -1 when unknown
+	GLenum blendSrcRGB = UNKNOWN;
+	GLenum blendDstRGB = UNKNOWN;
+	GLenum blendSrcAlpha = UNKNOWN;
+	GLenum blendDstAlpha = UNKNOWN;
+	GLint depthTestEnabled = -1;
+	GLfloat pointSize = -1.f;
+	GLfloat lineWidth = -1.f;
+
+	// per frame stats
+	unsigned int callCount = 0; // calls that reached GL
+	unsigned int elidedCount = 0; // redundant calls skipped
+};
+
+// everything is unknown, the next calls all reach GL
+void invalidateGLStateCache(GLStateCache& cache);
+
+// forgets the bound objects, to call after deleting an object the engine may have bound
+void invalidateGLStateObjects(GLStateCache& cache);
+
+// forgets the bound objects and resets the stats, the fixed function state is still trusted
+void beginGLStateCacheFrame(GLStateCache& cache);
+
+void setProgram(GLStateCache& cache, GLuint program);
+void setVertexArray(GLStateCache& cache, GLuint vao);
+void setDrawIndirectBuffer(GLStateCache& cache, GLuint buffer);
+void setBlendEnabled(GLStateCache& cache, bool enabled);
+void setBlendFuncSeparate(GLStateCache& cache, GLenum srcRGB, GLenum dstRGB, GLenum srcAlpha, GLenum dstAlpha);
+void setDepthTestEnabled(GLStateCache& cache, bool enabled);
+void setPointSize(GLStateCache& cache, GLfloat size);
+void setLineWidth(GLStateCache& cache, GLfloat width);
@@ -0,0 +1,47 @@
+#include "gputimer.h"
+
+#include <assert.h>
+
+void createGpuTimer(GpuTimer& timer) {
+	timer = GpuTimer();
+	glCreateQueries(GL_TIMESTAMP, GpuTimer::FRAMES_IN_FLIGHT * GpuTimer::MAX_SECTIONS * 2, &timer.queries[0][0][0]);
+}
+
+void deleteGpuTimer(GpuTimer& timer) {
+	glDeleteQueries(GpuTimer::FRAMES_IN_FLIGHT * GpuTimer::MAX_SECTIONS * 2, &timer.queries[0][0][0]);
+	timer = GpuTimer();
+}
+
+void beginGpuTimerFrame(GpuTimer& timer) {
+	timer.frameIndex = (timer.frameIndex + 1) % GpuTimer::FRAMES_IN_FLIGHT;
+
+	// the end timestamp is queued last, the begin one is available when it is
+	for (unsigned int section = 0; section < GpuTimer::MAX_SECTIONS; ++section) {
+		bool& issued = timer.issued[timer.frameIndex][section];
+		const GLuint* pQueries = timer.queries[timer.frameIndex][section];
+		if (!issued) {
+			timer.sectionMs[section] = 0.f;
+			continue;
+		}
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(pQueries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			GLuint64 begin, end;
+			glGetQueryObjectui64v(pQueries[0], GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(pQueries[1], GL_QUERY_RESULT, &end);
+			timer.sectionMs[section] = float(double(end - begin) * 1e-6);
+		}
+		issued = false;
+	}
+}
+
+void beginGpuTimerSection(GpuTimer& timer, unsigned int section) {
+	assert(section < GpuTimer::MAX_SECTIONS);
+	glQueryCounter(timer.queries[timer.frameIndex][section][0], GL_TIMESTAMP);
+}
+
+void endGpuTimerSection(GpuTimer& timer, unsigned int section) {
+	assert(section < GpuTimer::MAX_SECTIONS);
+	glQueryCounter(timer.queries[timer.frameIndex][section][1], GL_TIMESTAMP);
+	timer.issued[timer.frameIndex][section] = true;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <glad.h>
+
+// GPU duration of sections of the frame, from GL_TIMESTAMP queries around each section (they can nest, unlike GL_TIME_ELAPSED).
+// The queries of a frame are read when their slot comes back FRAMES_IN_FLIGHT frames later, and only if the GPU is done
+// with them: reading the results never waits, a result that is not available yet keeps the previous value
+struct GpuTimer {
+	enum { FRAMES_IN_FLIGHT = 3, MAX_SECTIONS = 8 };
+
+	GLuint queries[FRAMES_IN_FLIGHT][MAX_SECTIONS][2] = {}; // begin and end timestamps
+	bool issued[FRAMES_IN_FLIGHT][MAX_SECTIONS] = {}; // both timestamps were queued during the frame of the slot
+	unsigned int frameIndex = 0;
+
+	float sectionMs[MAX_SECTIONS] = {}; // latest available results, 0 for a section not timed
+};
+
+void createGpuTimer(GpuTimer& timer);
+
+void deleteGpuTimer(GpuTimer& timer);
+
+// moves to the slot of a new frame, collects the results the slot held
+void beginGpuTimerFrame(GpuTimer& timer);
+
+// a section is timed at most once per frame
+void beginGpuTimerSection(GpuTimer& timer, unsigned int section);
+void endGpuTimerSection(GpuTimer& timer, unsigned int section);
@@ -3,6 +3,9 @@
 #include "renderapi.h"
 
 #include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <imgui.h>
 #include <GLFW/glfw3.h>
 #include <glm/mat4x4.hpp>
@@ -15,12 +18,48 @@
 #include "particles3Dviewer.cpp"
 
 
+namespace {
+	// frames of a headless run written as <prefix>NNNN.ppm
+	void writeFramePPM(unsigned int frameIndex, const unsigned char* pPixels, int width, int height, void* pUserData) {
+		const char* prefix = static_cast<const char*>(pUserData);
+		char path[1024];
+		snprintf(path, sizeof(path), "%s%04u.ppm", prefix, frameIndex);
+		FILE* pFile = fopen(path, "wb");
+		if (!pFile) {
+			fprintf(stderr, "Failed to write %s\n", path);
+			return;
+		}
+		fprintf(pFile, "P6\n%d %d\n255\n", width, height);
+		// ppm rows go top to bottom, without alpha
+		for (int y = height - 1; y >= 0; --y) {
+			const unsigned char* pRow = pPixels + size_t(y) * width * 4;
+			for (int x = 0; x < width; ++x) {
+				fwrite(pRow + x * 4, 1, 3, pFile);
+			}
+		}
+		fclose(pFile);
+	}
+}
 
+// usage: [--headless <frame count>] [--capture <path prefix>]
 int main(int argc, char** argv) {
 	//MyDefaultViewer v;
 	//MyBoidsViewer v;
 	//MyParticlesViewer v;
 	MyParticles3DViewer v;
 
-	return v.run();
+	bool headless = false;
+	HeadlessParams headlessParams;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc) {
+			headless = true;
+			headlessParams.frameCount = unsigned(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+			headlessParams.readbackCallback = writeFramePPM;
+			headlessParams.pReadbackUserData = argv[++i];
+		}
+	}
+
+	return headless ? v.runHeadless(headlessParams) : v.run();
 }
@@ -0,0 +1,44 @@
+#include "mappedbuffer.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+bool createMappedStorage(GLsizeiptr size, GLuint& buffer, char*& pMapped) {
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	GLuint newBuffer;
+	glCreateBuffers(1, &newBuffer);
+	glNamedBufferStorage(newBuffer, size, nullptr, flags);
+	char* pNewMapped = (char*)glMapNamedBufferRange(newBuffer, 0, size, flags);
+	if (!pNewMapped) {
+		fprintf(stderr, "Failed to map a buffer of %lld bytes\n", (long long)size);
+		glDeleteBuffers(1, &newBuffer);
+		return false;
+	}
+	buffer = newBuffer;
+	pMapped = pNewMapped;
+	return true;
+}
+
+void deleteMappedStorage(GLuint& buffer, char*& pMapped) {
+	if (buffer) {
+		glUnmapNamedBuffer(buffer);
+		glDeleteBuffers(1, &buffer);
+	}
+	buffer = 0;
+	pMapped = nullptr;
+}
+
+void waitFence(GLsync& fence) {
+	if (!fence) {
+		return;
+	}
+	GLenum result = glClientWaitSync(fence, 0, 0);
+	while (result == GL_TIMEOUT_EXPIRED) {
+		// the first wait did not flush, make sure the fence reaches the GPU
+		result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+	}
+	assert(result != GL_WAIT_FAILED);
+	glDeleteSync(fence);
+	fence = nullptr;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <glad.h>
+
+// Storage and fences shared by the persistently mapped buffers (TransientBuffer, PersistentStorageBuffer):
+// the CPU writes a region of the mapping while the GPU still reads the regions of the previous frames
+
+// size bytes mapped for writing, persistent and coherent. buffer and pMapped are left as they are when it fails
+bool createMappedStorage(GLsizeiptr size, GLuint& buffer, char*& pMapped);
+
+// unmaps and deletes buffer, does nothing for 0
+void deleteMappedStorage(GLuint& buffer, char*& pMapped);
+
+// waits until the GPU passed the fence and deletes it, does nothing for a null fence
+void waitFence(GLsync& fence);
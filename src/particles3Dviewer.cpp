@@ -30,17 +30,20 @@ struct MyParticles3DViewer : Viewer {
 	struct Particle {
 
 		glm::vec3 position;
+		glm::vec3 previousPosition; // before the last step, see simulationAlpha
 		float velocity;
 		glm::vec3 direction;
 		const float padding = 0.5f;
 
 		Particle(glm::vec3 initPosition) {
 			position = initPosition;
+			previousPosition = initPosition;
 			velocity = 1.0f;
 			direction = { 0, 0, 0 };
 		}
 
 		void updatePosition(std::vector<Well*> wellList) {
+			previousPosition = position;
 
 			for (Well* well : wellList) {
 				glm::vec3 vecDir = well->position - position;
@@ -58,6 +61,7 @@ struct MyParticles3DViewer : Viewer {
 
 	glm::vec3 jointPosition;
 	glm::vec3 cubePosition;
+	bool useSphereImpostors = true; // ray cast quads instead of tessellated spheres
 	float boneAngle;
 
 	glm::vec2 mousePos;
@@ -70,6 +74,11 @@ struct MyParticles3DViewer : Viewer {
 	std::vector<Well*> wellList;
 	std::vector<Particle*> particleList;
 
+	// per sphere arrays of render3D, kept between frames to reuse their allocation
+	mutable std::vector<glm::vec3> sphereCenters;
+	mutable std::vector<float> sphereRadii;
+	mutable std::vector<glm::vec4> sphereColors;
+
 	MyParticles3DViewer() : Viewer(viewerName, 1280, 720) {}
 
 	void init() override {
@@ -101,9 +110,7 @@ struct MyParticles3DViewer : Viewer {
 	}
 
 
-	void update(double elapsedTime) override {
-		boneAngle = (float)elapsedTime;
-
+	void beginFrame() override {
 		leftMouseButtonPressed = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
 
 		altKeyPressed = glfwGetKey(window, GLFW_KEY_LEFT_ALT) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_RIGHT_ALT) == GLFW_PRESS;
@@ -116,6 +123,10 @@ struct MyParticles3DViewer : Viewer {
 
 		pCustomShaderData = &additionalShaderData;
 		CustomShaderDataSize = sizeof(VertexShaderAdditionalData);
+	}
+
+	void update(double elapsedTime) override {
+		boneAngle = (float)elapsedTime;
 
 		//UPDATE PARTICLES
 		for (Particle* particle : particleList) {
@@ -128,12 +139,15 @@ struct MyParticles3DViewer : Viewer {
 		//api.horizontalPlane({ 0, 2, 0 }, { 4, 4 }, 200, glm::vec4(0.0f, 0.2f, 1.f, 1.f));
 	}
 
-	void render3D(const RenderApi3D& api) const override {
+	void renderStatic3D(const RenderApi3D& api) const override {
 		//api.horizontalPlane({ 0, 0, 0 }, { 10, 10 }, 1, glm::vec4(0.9f, 0.9f, 0.9f, 1.f));
 
 		api.grid(10.f, 10, glm::vec4(0.5f, 0.5f, 0.5f, 1.f), nullptr);
 
 		api.axisXYZ(nullptr);
+	}
+
+	void render3D(const RenderApi3D& api) const override {
 
 		/*constexpr float cubeSize = 0.5f;
 		glm::mat4 cubeModelMatrix = glm::translate(glm::identity<glm::mat4>(), cubePosition);
@@ -164,11 +178,32 @@ struct MyParticles3DViewer : Viewer {
 		//api.solidSphere(glm::vec3(-1.f, 0.5f, 1.f), 0.5f, 100, 100, white);
 
 		//DRAW PARTICLES & WELLS
+		//one instanced draw for the opaque particles and one for the translucent wells, each goes to its own bucket
+		sphereCenters.clear();
+		sphereRadii.clear();
+		sphereColors.clear();
 		for (Particle* particle : particleList) {
-			api.solidSphere(particle->position, particle->padding, 100, 100, pink);
+			sphereCenters.push_back(glm::mix(particle->previousPosition, particle->position, simulationAlpha));
+			sphereRadii.push_back(particle->padding);
+			sphereColors.push_back(pink);
 		}
 		for (Well* well : wellList) {
-			api.solidSphere(well->position, well->padding, 100, 100, translucideGreen);
+			sphereCenters.push_back(well->position);
+			sphereRadii.push_back(well->padding);
+			sphereColors.push_back(translucideGreen);
+		}
+		const unsigned int particleCount = (unsigned int)particleList.size();
+		const unsigned int wellCount = (unsigned int)wellList.size();
+		drawSpheres(api, 0, particleCount);
+		drawSpheres(api, particleCount, wellCount);
+	}
+
+	void drawSpheres(const RenderApi3D& api, unsigned int first, unsigned int count) const {
+		if (useSphereImpostors) {
+			api.sphereImpostors(sphereCenters.data() + first, sphereRadii.data() + first, sphereColors.data() + first, count);
+		}
+		else {
+			api.solidSpheres(sphereCenters.data() + first, sphereRadii.data() + first, sphereColors.data() + first, count, 100, 100);
 		}
 	}
 
@@ -255,6 +290,7 @@ struct MyParticles3DViewer : Viewer {
 		}
 
 		ImGui::SliderFloat3("Cube Position", (float(&)[3])cubePosition, -1.f, 1.f);
+		ImGui::Checkbox("Sphere impostors", &useSphereImpostors);
 
 		ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
 
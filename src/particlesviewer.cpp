@@ -30,17 +30,20 @@ struct MyParticlesViewer : Viewer {
 	struct Particle {
 
 		glm::vec2 position;
+		glm::vec2 previousPosition; // before the last step, see simulationAlpha
 		float velocity;
 		glm::vec2 direction;
 		const float padding = 5.0f;
 
 		Particle(glm::vec2 initPosition) {
 			position = initPosition;
+			previousPosition = initPosition;
 			velocity = 1.0f;
 			direction = {0, 0};
 		}
 
 		void updatePosition(std::vector<Well*> wellList) {
+			previousPosition = position;
 
 			for(Well* well : wellList) {
 				glm::vec2 vecDir = well->position - position;
@@ -99,9 +102,7 @@ struct MyParticlesViewer : Viewer {
 	}
 
 
-	void update(double elapsedTime) override {
-		boneAngle = (float)elapsedTime;
-
+	void beginFrame() override {
 		leftMouseButtonPressed = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
 
 		altKeyPressed = glfwGetKey(window, GLFW_KEY_LEFT_ALT) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_RIGHT_ALT) == GLFW_PRESS;
@@ -114,6 +115,10 @@ struct MyParticlesViewer : Viewer {
 
 		pCustomShaderData = &additionalShaderData;
 		CustomShaderDataSize = sizeof(VertexShaderAdditionalData);
+	}
+
+	void update(double elapsedTime) override {
+		boneAngle = (float)elapsedTime;
 
 		//UPDATE PARTICLES
 		for (Particle* particle : particleList) {
@@ -210,7 +215,7 @@ struct MyParticlesViewer : Viewer {
 
 		//DRAW PARTICLES & WELLS
 		for (Particle* particle : particleList) {
-			api.circleContour(particle->position, particle->padding, 20, pink);
+			api.circleContour(glm::mix(particle->previousPosition, particle->position, simulationAlpha), particle->padding, 20, pink);
 		}
 		for (Well* well : wellList) {
 			api.circleContour(well->position, well->padding, 20, white);
@@ -0,0 +1,142 @@
+#include "persistentbuffer.h"
+#include "mappedbuffer.h"
+
+#include <assert.h>
+#include <string.h>
+
+namespace {
+	// the regions keep the offset alignment of the binding target. the storage of storageBuffer is left as is when it fails
+	bool createStorage(PersistentStorageBuffer& storageBuffer, GLsizeiptr regionCapacity) {
+		const GLsizeiptr alignment = storageBuffer.offsetAlignment;
+		regionCapacity = ((regionCapacity + alignment - 1) / alignment) * alignment;
+		if (!createMappedStorage(regionCapacity * PersistentStorageBuffer::FRAMES_IN_FLIGHT, storageBuffer.buffer, storageBuffer.pMapped)) {
+			return false;
+		}
+		storageBuffer.regionCapacity = regionCapacity;
+		return true;
+	}
+
+	// [begin, end) of the bytes that differ, begin == end when a and b are equal
+	void findChangedRange(const char* a, const char* b, GLsizeiptr size, GLsizeiptr& begin, GLsizeiptr& end) {
+		// memcmp on blocks first, the payload is often unchanged or changed in a few places
+		constexpr GLsizeiptr BLOCK_SIZE = 64;
+		begin = 0;
+		while (begin < size) {
+			const GLsizeiptr blockSize = size - begin < BLOCK_SIZE ? size - begin : BLOCK_SIZE;
+			if (memcmp(a + begin, b + begin, blockSize) != 0) {
+				break;
+			}
+			begin += blockSize;
+		}
+		end = size;
+		while (end > begin) {
+			const GLsizeiptr blockSize = end - begin < BLOCK_SIZE ? end - begin : BLOCK_SIZE;
+			if (memcmp(a + end - blockSize, b + end - blockSize, blockSize) != 0) {
+				break;
+			}
+			end -= blockSize;
+		}
+	}
+
+	void markDirty(PersistentStorageBuffer& storageBuffer, GLsizeiptr begin, GLsizeiptr end) {
+		for (unsigned int i = 0; i < PersistentStorageBuffer::FRAMES_IN_FLIGHT; ++i) {
+			GLsizeiptr& dirtyBegin = storageBuffer.dirtyBegin[i];
+			GLsizeiptr& dirtyEnd = storageBuffer.dirtyEnd[i];
+			if (dirtyBegin >= dirtyEnd) {
+				dirtyBegin = begin;
+				dirtyEnd = end;
+			}
+			else {
+				dirtyBegin = begin < dirtyBegin ? begin : dirtyBegin;
+				dirtyEnd = end > dirtyEnd ? end : dirtyEnd;
+			}
+		}
+	}
+}
+
+bool createPersistentStorageBuffer(PersistentStorageBuffer& storageBuffer, GLenum target, GLsizeiptr regionCapacity) {
+	assert(storageBuffer.buffer == 0); // trying to create a buffer already initialized
+	assert(target == GL_SHADER_STORAGE_BUFFER || target == GL_UNIFORM_BUFFER);
+	GLint offsetAlignment = 1;
+	glGetIntegerv(target == GL_UNIFORM_BUFFER ? GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT : GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+	storageBuffer.target = target;
+	storageBuffer.offsetAlignment = offsetAlignment;
+	storageBuffer.frameIndex = 0;
+	storageBuffer.payload.clear();
+	storageBuffer.writtenSize = 0;
+	for (unsigned int i = 0; i < PersistentStorageBuffer::FRAMES_IN_FLIGHT; ++i) {
+		storageBuffer.fences[i] = nullptr;
+		storageBuffer.dirtyBegin[i] = 0;
+		storageBuffer.dirtyEnd[i] = 0;
+	}
+	return createStorage(storageBuffer, regionCapacity);
+}
+
+void deletePersistentStorageBuffer(PersistentStorageBuffer& storageBuffer) {
+	for (GLsync& fence : storageBuffer.fences) {
+		waitFence(fence);
+	}
+	deleteMappedStorage(storageBuffer.buffer, storageBuffer.pMapped);
+	storageBuffer.payload.clear();
+}
+
+bool updatePersistentStorageBuffer(PersistentStorageBuffer& storageBuffer, const void* pData, GLsizeiptr size, GLuint binding) {
+	assert(pData && size > 0);
+	storageBuffer.frameIndex = (storageBuffer.frameIndex + 1) % PersistentStorageBuffer::FRAMES_IN_FLIGHT;
+	waitFence(storageBuffer.fences[storageBuffer.frameIndex]);
+
+	if (size > storageBuffer.regionCapacity) {
+		// every region is reallocated, wait until the GPU is done with all of them
+		for (GLsync& fence : storageBuffer.fences) {
+			waitFence(fence);
+		}
+		GLsizeiptr newRegionCapacity = 2 * storageBuffer.regionCapacity;
+		while (size > newRegionCapacity) {
+			newRegionCapacity *= 2;
+		}
+		GLuint oldBuffer = storageBuffer.buffer;
+		char* pOldMapped = storageBuffer.pMapped;
+		if (!createStorage(storageBuffer, newRegionCapacity)) {
+			return false;
+		}
+		deleteMappedStorage(oldBuffer, pOldMapped);
+		storageBuffer.payload.clear();
+	}
+
+	const char* pBytes = static_cast<const char*>(pData);
+	if (GLsizeiptr(storageBuffer.payload.size()) != size) {
+		storageBuffer.payload.assign(pBytes, pBytes + size);
+		markDirty(storageBuffer, 0, size);
+	}
+	else {
+		GLsizeiptr changedBegin;
+		GLsizeiptr changedEnd;
+		findChangedRange(storageBuffer.payload.data(), pBytes, size, changedBegin, changedEnd);
+		if (changedBegin < changedEnd) {
+			memcpy(storageBuffer.payload.data() + changedBegin, pBytes + changedBegin, changedEnd - changedBegin);
+			markDirty(storageBuffer, changedBegin, changedEnd);
+		}
+	}
+
+	// bring the region up to date with the payload
+	const unsigned int frameIndex = storageBuffer.frameIndex;
+	const GLintptr regionOffset = frameIndex * storageBuffer.regionCapacity;
+	GLsizeiptr& dirtyBegin = storageBuffer.dirtyBegin[frameIndex];
+	GLsizeiptr& dirtyEnd = storageBuffer.dirtyEnd[frameIndex];
+	storageBuffer.writtenSize = 0;
+	if (dirtyBegin < dirtyEnd) {
+		storageBuffer.writtenSize = dirtyEnd - dirtyBegin;
+		memcpy(storageBuffer.pMapped + regionOffset + dirtyBegin, storageBuffer.payload.data() + dirtyBegin, storageBuffer.writtenSize);
+		dirtyBegin = 0;
+		dirtyEnd = 0;
+	}
+
+	glBindBufferRange(storageBuffer.target, binding, storageBuffer.buffer, regionOffset, size);
+	return true;
+}
+
+void endPersistentStorageBufferFrame(PersistentStorageBuffer& storageBuffer) {
+	GLsync& fence = storageBuffer.fences[storageBuffer.frameIndex];
+	assert(!fence);
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <glad.h>
+
+#include <vector>
+
+// Persistently mapped shader storage (or uniform) buffer holding one copy of a payload per frame in flight.
+// The payload is compared with the previous one, a region only receives the bytes that changed since it was last written.
+struct PersistentStorageBuffer {
+	enum { FRAMES_IN_FLIGHT = 3 };
+
+	GLuint buffer = 0;
+	char* pMapped = nullptr;
+	GLenum target = GL_SHADER_STORAGE_BUFFER; // or GL_UNIFORM_BUFFER, the indexed binding target of the regions
+
+	GLsizeiptr regionCapacity = 0; // size in bytes of one region, a multiple of the offset alignment of target
+	GLsizeiptr offsetAlignment = 1;
+	unsigned int frameIndex = 0;
+	GLsync fences[FRAMES_IN_FLIGHT] = {};
+
+	std::vector<char> payload; // last payload written
+	// bytes of each region that are older than payload, empty when dirtyBegin >= dirtyEnd
+	GLsizeiptr dirtyBegin[FRAMES_IN_FLIGHT] = {};
+	GLsizeiptr dirtyEnd[FRAMES_IN_FLIGHT] = {};
+
+	GLsizeiptr writtenSize = 0; // bytes written by the last update
+};
+
+bool createPersistentStorageBuffer(PersistentStorageBuffer& storageBuffer, GLenum target, GLsizeiptr regionCapacity);
+
+void deletePersistentStorageBuffer(PersistentStorageBuffer& storageBuffer);
+
+// moves to the region of the new frame (waits until the GPU released it), writes the bytes that changed and binds
+// the region to the binding point of target. the storage grows when size does not fit
+bool updatePersistentStorageBuffer(PersistentStorageBuffer& storageBuffer, const void* pData, GLsizeiptr size, GLuint binding);
+
+// fences the region used by the frame, only after a frame that called updatePersistentStorageBuffer
+void endPersistentStorageBufferFrame(PersistentStorageBuffer& storageBuffer);
@@ -4,228 +4,312 @@
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/packing.hpp>
+#include <glm/gtc/packing.hpp>
 #include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include <float.h>
 
 #define COUNTOF(ARRAY) (sizeof(ARRAY) / sizeof(ARRAY[0]))
 
 namespace {
-	struct DUMMY_STACKED_ALLOCATOR {
-		enum { MAX_SIZE = 16 * 1024 * 1024};
-		char* pCurrent;
-		int SizeInUse;
-		DUMMY_STACKED_ALLOCATOR() {
-			pCurrent = new char[MAX_SIZE];
-		}
-		void* Allocate(int Size) {
-			assert(SizeInUse + Size < MAX_SIZE);
-			char* pToReturn = pCurrent;
-			pCurrent += Size + 4;
-			*(int*)pToReturn = Size + 4;
-			SizeInUse += Size + 4;
-			return (void*)(pToReturn + 4);
+	// appends vertexCount vertices to a staging array of the 2D batch and returns them for writing
+	TransientVertex2D* appendVertices2D(std::vector<TransientVertex2D>& vertices, unsigned int vertexCount) {
+		const size_t first = vertices.size();
+		vertices.resize(first + vertexCount);
+		return vertices.data() + first;
+	}
+
+	// unitCircle[i] is the point at angle 2*pi*i/subdivisions, for i in [0, subdivisions]
+	glm::vec2 const* getUnitCircle2D(DrawBatch2D& batch, unsigned int subdivisions) {
+		std::vector<glm::vec2>& unitCircle = batch.unitCircles[subdivisions];
+		if (unitCircle.empty()) {
+			unitCircle.resize(subdivisions + 1);
+			for (unsigned int i = 0; i <= subdivisions; ++i) {
+				const float angle = glm::two_pi<float>() * i / float(subdivisions);
+				unitCircle[i] = { glm::cos(angle), glm::sin(angle) };
+			}
 		}
-		void Free(void* pPointer) {
-			assert(pPointer < pCurrent);
-			int* pSize = (int*)pPointer;
-			--pSize;
-			SizeInUse -= *pSize;
-			pCurrent = (char*)pSize;
+		return unitCircle.data();
+	}
+
+	// the instance, the vertices and the indices of a draw share one allocation, an overflow can never split them.
+	// nullptr when the transient buffer cannot hold it, the draw is dropped
+	void* allocateDrawData3D(const RenderApi3D& api, GLsizeiptr size, GLsizeiptr alignment, GLintptr& offset) {
+		RenderEngine& engine = *api.pRenderEngine;
+		if (!transientBufferHasRoom(engine.transientBuffer, size, alignment)) {
+			// the recorded commands read from the transient buffer, submit them before the region gets recycled
+			flushDrawCommands3D(engine);
 		}
-	};
-	DUMMY_STACKED_ALLOCATOR Allocator;
-}
+		return allocateEngineTransient(engine, size, alignment, offset);
+	}
 
-void RenderApi3D::buffer(const Buffer3D& buffer, eDrawMode drawMode, glm::mat4 const* pModel) const {
-	glm::mat4 model = pModel ? *pModel : glm::identity<glm::mat4>();
-	glProgramUniformMatrix4fv(pShader3D->programId, pShader3D->modelLocation, 1, 0, glm::value_ptr(model));
+	// sphere (center, radius) around bounds once transformed by model, the radius follows the largest scale of the axes
+	glm::vec4 transformBoundingSphere(const glm::mat4& model, const glm::vec4& bounds) {
+		const float scale2 = glm::max(glm::max(glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+			glm::dot(glm::vec3(model[1]), glm::vec3(model[1]))), glm::dot(glm::vec3(model[2]), glm::vec3(model[2])));
+		return glm::vec4(glm::vec3(model * glm::vec4(glm::vec3(bounds), 1.f)), bounds.w * glm::sqrt(scale2));
+	}
 
-	const bool lightingEnabled = buffer.vbos[Buffer3D::BufferAttribNormal] != 0;
-	glProgramUniform1i(pShader3D->programId, pShader3D->lightingEnabledLocation, lightingEnabled);
+	// box around the bounding spheres of the instances of a draw
+	struct InstanceBounds {
+		glm::vec3 boxMin = glm::vec3(FLT_MAX);
+		glm::vec3 boxMax = glm::vec3(-FLT_MAX);
+	};
 
-	assert(buffer.vao); // did you call createDrawBuffer3D ?
-	glBindVertexArray(buffer.vao);
-	if (buffer.ibo != 0) {
-		glDrawElements((GLenum)drawMode, buffer.indexCount, GL_UNSIGNED_INT, nullptr);
+	void addInstanceBounds(InstanceBounds& instanceBounds, const glm::vec4& sphere) {
+		instanceBounds.boxMin = glm::min(instanceBounds.boxMin, glm::vec3(sphere) - sphere.w);
+		instanceBounds.boxMax = glm::max(instanceBounds.boxMax, glm::vec3(sphere) + sphere.w);
 	}
-	else {
-		glDrawArrays((GLenum)drawMode, 0, buffer.vertexCount);
+
+	glm::vec4 getDrawBounds(const InstanceBounds& instanceBounds) {
+		return glm::vec4(0.5f * (instanceBounds.boxMin + instanceBounds.boxMax), 0.5f * glm::distance(instanceBounds.boxMin, instanceBounds.boxMax));
 	}
-	glBindVertexArray(0);
-}
 
-void RenderApi3D::lines(glm::vec3 const* vertices, unsigned int vertexCount, const glm::vec4& color, glm::mat4 const* pModel) const {
-	glm::vec4* colors = (glm::vec4*)Allocator.Allocate(sizeof(glm::vec4) * vertexCount);
-	for (unsigned int i = 0; i < vertexCount; ++i) {
-		colors[i] = color;
+	struct TransientDraw3D {
+		TransientVertex3D* pVertices = nullptr; // nullptr when the draw is dropped
+		unsigned int* pIndices = nullptr; // nullptr when indexCount is 0
+	};
+
+	// getShaderVariant3D for a draw of the current frame, counts the draws skipped while their program is building
+	ShaderProgram3D const* getFrameShader(RenderEngine& engine, ShaderVariants3D& variants, unsigned int permutation) {
+		ShaderProgram3D const* pShader = getShaderVariant3D(variants, permutation, engine.waitForShaders);
+		if (!pShader && variants.programs[permutation].linkPending) {
+			++engine.skippedDrawCount;
+		}
+		return pShader;
 	}
 
-	Buffer3D buffer3D;
+	// the permutation of the program of the api for the draw, nullptr when it does not build or is still building: the draw is dropped
+	ShaderProgram3D const* getDrawShader(const RenderApi3D& api, bool lightingEnabled, bool procedural) {
+		const unsigned int permutation = (lightingEnabled ? ShaderPermutationLighting : 0) | (procedural ? ShaderPermutationProcedural : 0);
+		return getFrameShader(*api.pRenderEngine, *api.pShaders3D, permutation);
+	}
 
-	CreateBuffer3DParams createCubeBufferParams;
-	createCubeBufferParams.pVertices = vertices;
-	createCubeBufferParams.pNormals = nullptr;
-	createCubeBufferParams.pColors = colors;
-	createCubeBufferParams.vertexCount = vertexCount;
-	createBuffer3D(buffer3D, createCubeBufferParams);
+	// params of a regular (not procedural) instance
+	glm::ivec4 getInstanceParams() {
+		return glm::ivec4((int)eProceduralShape::None, 0, 0, 0);
+	}
 
-	buffer(buffer3D, eDrawMode::Lines, pModel);
+	// records a draw of the transient vertex array, the caller fills the returned vertices and indices.
+	// localBounds is the bounding sphere of these vertices
+	TransientDraw3D recordTransientDraw3D(const RenderApi3D& api, eDrawMode drawMode, unsigned int vertexCount, unsigned int indexCount, glm::mat4 const* pModel, const glm::vec4& color, bool lightingEnabled,
+		const glm::vec4& localBounds) {
+		const GLsizeiptr size = sizeof(InstanceData3D) + vertexCount * sizeof(TransientVertex3D) + indexCount * sizeof(unsigned int);
+		GLintptr offset;
+		char* pData = (char*)allocateDrawData3D(api, size, sizeof(InstanceData3D), offset);
+		TransientDraw3D draw;
+		if (!pData) {
+			return draw;
+		}
 
-	deleteBuffer3D(buffer3D);
+		const glm::mat4 model = pModel ? *pModel : glm::identity<glm::mat4>();
+		InstanceData3D* pInstance = reinterpret_cast<InstanceData3D*>(pData);
+		pInstance->model = model;
+		pInstance->color = color;
+		pInstance->params = getInstanceParams();
 
-	Allocator.Free(colors);
-}
+		draw.pVertices = reinterpret_cast<TransientVertex3D*>(pInstance + 1);
+		draw.pIndices = indexCount ? reinterpret_cast<unsigned int*>(draw.pVertices + vertexCount) : nullptr;
 
-void RenderApi3D::grid(float size, unsigned int subdivisions, const glm::vec4& color, glm::mat4 const* pModel) const {
-	subdivisions = glm::max(subdivisions, 1u);
+		// offset is a multiple of sizeof(InstanceData3D), hence of sizeof(TransientVertex3D) and sizeof(unsigned int)
+		const GLintptr vertexOffset = offset + sizeof(InstanceData3D);
+		const GLintptr indexOffset = vertexOffset + vertexCount * sizeof(TransientVertex3D);
 
-	const unsigned int lineCount = 4 + 2 * (subdivisions - 1);
-	const unsigned int vertexCount = 2 * lineCount;
-	glm::vec3* vertices = (glm::vec3*)Allocator.Allocate(sizeof(glm::vec3) * vertexCount);
-	glm::vec4* colors = (glm::vec4*)Allocator.Allocate(sizeof(glm::vec4) * vertexCount);
+		DrawCommand3D command;
+		command.pShader = getDrawShader(api, lightingEnabled, false);
+		if (!command.pShader) {
+			return draw;
+		}
+		command.vao = api.pRenderEngine->transientVao3D;
+		command.drawMode = (GLenum)drawMode;
+		command.indexed = indexCount != 0;
+		if (command.indexed) {
+			command.count = indexCount;
+			command.first = GLuint(indexOffset / sizeof(unsigned int));
+			command.baseVertex = GLint(vertexOffset / sizeof(TransientVertex3D));
+		}
+		else {
+			command.count = vertexCount;
+			command.first = GLuint(vertexOffset / sizeof(TransientVertex3D));
+			command.baseVertex = 0;
+		}
+		command.instanceCount = 1;
+		command.baseInstance = GLuint(offset / sizeof(InstanceData3D));
+		command.translucent = color.a < 1.f;
+		command.bounds = transformBoundingSphere(model, localBounds);
+		recordDrawCommand3D(api.pRenderEngine->drawCommands3D, command);
 
-	const float halfSize = 0.5f * size;
+		return draw;
+	}
 
-	int iVertex = 0;
+	// records a primitive generated by the vertex shader, nothing but the instance is uploaded.
+	// the shape fits in a sphere of radius localRadius around the origin of model
+	void recordProceduralDraw3D(const RenderApi3D& api, eProceduralShape shape, int param0, int param1, eDrawMode drawMode, GLuint vertexCount, const glm::mat4& model, const glm::vec4& color, bool lightingEnabled,
+		float localRadius) {
+		GLintptr offset;
+		InstanceData3D* pInstance = (InstanceData3D*)allocateDrawData3D(api, sizeof(InstanceData3D), sizeof(InstanceData3D), offset);
+		if (!pInstance) {
+			return;
+		}
+		pInstance->model = model;
+		pInstance->color = color;
+		pInstance->params = glm::ivec4((int)shape, param0, param1, 0);
+
+		DrawCommand3D command;
+		command.pShader = getDrawShader(api, lightingEnabled, true);
+		if (!command.pShader) {
+			return;
+		}
+		command.vao = api.pRenderEngine->proceduralVao;
+		command.drawMode = (GLenum)drawMode;
+		command.indexed = false;
+		command.count = vertexCount;
+		command.first = 0;
+		command.baseVertex = 0;
+		command.instanceCount = 1;
+		command.baseInstance = GLuint(offset / sizeof(InstanceData3D));
+		command.translucent = color.a < 1.f;
+		command.bounds = transformBoundingSphere(model, glm::vec4(0.f, 0.f, 0.f, localRadius));
+		recordDrawCommand3D(api.pRenderEngine->drawCommands3D, command);
+	}
 
-	vertices[iVertex++] = glm::vec3(-halfSize, 0.f, halfSize);
-	vertices[iVertex++] = glm::vec3(halfSize, 0.f, halfSize);
-	vertices[iVertex++] = glm::vec3(-halfSize, 0.f, -halfSize);
-	vertices[iVertex++] = glm::vec3(halfSize, 0.f, -halfSize);
-	vertices[iVertex++] = glm::vec3(-halfSize, 0.f, halfSize);
-	vertices[iVertex++] = glm::vec3(-halfSize, 0.f, -halfSize);
-	vertices[iVertex++] = glm::vec3(halfSize, 0.f, halfSize);
-	vertices[iVertex++] = glm::vec3(halfSize, 0.f, -halfSize);
+	// maps the cached bone mesh (see getBoneMesh) to the bone going from the parent joint to the child joint
+	glm::mat4 computeBoneModel(const glm::vec3& childRelativePosition, const glm::quat& parentAbsoluteRotation, const glm::vec3& parentAbsolutePosition) {
+		const float size = glm::length(childRelativePosition) / 10.f;
+
+		glm::vec3 front = glm::normalize(childRelativePosition);
+		glm::vec3 left;
+		glm::vec3 up;
+		const float frontDot = glm::dot(front, glm::vec3(0.f, 1.f, 0.f));
+		if (glm::abs(frontDot) != 1.f) {
+			left = glm::normalize(glm::cross(glm::vec3(0.f, 1.f, 0.f), front));
+			up = glm::normalize(glm::cross(front, left));
+		}
+		else {
+			up = glm::normalize(glm::cross(front, glm::vec3(1.f, 0.f, 0.f)));
+			left = glm::normalize(glm::cross(up, front));
+		}
 
-	for (unsigned int i = 1; i < subdivisions; ++i) {
-		const float coord = -halfSize + size * (i / float(subdivisions));
-		vertices[iVertex++] = glm::vec3(coord, 0.f, -halfSize);
-		vertices[iVertex++] = glm::vec3(coord, 0.f, halfSize);
-		vertices[iVertex++] = glm::vec3(-halfSize, 0.f, coord);
-		vertices[iVertex++] = glm::vec3(halfSize, 0.f, coord);
+		// left, up and front are the X, Y and Z axes of the mesh
+		glm::mat4 model;
+		model[0] = glm::vec4(parentAbsoluteRotation * (size * left), 0.f);
+		model[1] = glm::vec4(parentAbsoluteRotation * (size * up), 0.f);
+		model[2] = glm::vec4(parentAbsoluteRotation * (size * front), 0.f);
+		model[3] = glm::vec4(parentAbsolutePosition, 1.f);
+		return model;
 	}
 
-	for (unsigned int i = 0; i < vertexCount; ++i) {
-		colors[i] = color;
+	// a bone from the parent joint to the joint i, false for a root, an invalid parent and a zero length bone
+	bool isSkeletonBoneDrawn(int const* parentIndices, glm::vec3 const* worldPositions, unsigned int boneCount, unsigned int i) {
+		const int iParent = parentIndices[i];
+		assert(iParent < int(boneCount)); // parent index out of the joint arrays
+		return iParent >= 0 && iParent < int(boneCount) && worldPositions[i] != worldPositions[iParent];
 	}
 
-	Buffer3D buffer3D;
+	// nullptr when the draw is dropped, see allocateDrawData3D
+	InstanceData3D* allocateInstances3D(const RenderApi3D& api, unsigned int instanceCount, GLuint& baseInstance) {
+		GLintptr offset;
+		void* pData = allocateDrawData3D(api, instanceCount * sizeof(InstanceData3D), sizeof(InstanceData3D), offset);
+		baseInstance = GLuint(offset / sizeof(InstanceData3D));
+		return reinterpret_cast<InstanceData3D*>(pData);
+	}
 
-	CreateBuffer3DParams createCubeBufferParams;
-	createCubeBufferParams.pVertices = vertices;
-	createCubeBufferParams.pNormals = nullptr;
-	createCubeBufferParams.pColors = colors;
-	createCubeBufferParams.vertexCount = vertexCount;
-	createBuffer3D(buffer3D, createCubeBufferParams);
+	// records instanceCount instances of mesh, the per instance data starts at baseInstance in the transient buffer.
+	// bounds is the world space bounding sphere of every instance
+	void recordMeshDraw3D(const RenderApi3D& api, const Buffer3D& mesh, eDrawMode drawMode, GLuint baseInstance, unsigned int instanceCount, bool translucent, const glm::vec4& bounds) {
+		assert(mesh.vao); // did you call createDrawBuffer3D ?
 
-	buffer(buffer3D, eDrawMode::Lines, pModel);
+		DrawCommand3D command;
+		command.pShader = getDrawShader(api, mesh.hasNormals, false);
+		if (!command.pShader) {
+			return;
+		}
+		command.vao = mesh.vao;
+		command.drawMode = (GLenum)drawMode;
+		command.indexed = mesh.indexStorage.buffer != 0;
+		command.count = command.indexed ? mesh.indexCount : mesh.vertexCount;
+		// a shared vertex array binds the whole arena block, the vertices of the mesh start at its baseVertex
+		command.first = command.indexed ? mesh.firstIndex : GLuint(mesh.baseVertex);
+		command.baseVertex = command.indexed ? mesh.baseVertex : 0;
+		command.instanceCount = instanceCount;
+		command.baseInstance = baseInstance;
+		command.translucent = translucent || mesh.hasTranslucentColors;
+		command.bounds = bounds;
+		recordDrawCommand3D(api.pRenderEngine->drawCommands3D, command);
+	}
 
-	deleteBuffer3D(buffer3D);
+	void recordMeshDraw3D(const RenderApi3D& api, const Buffer3D& mesh, eDrawMode drawMode, const glm::mat4& model, const glm::vec4& color) {
+		GLuint baseInstance;
+		InstanceData3D* pInstance = allocateInstances3D(api, 1, baseInstance);
+		if (!pInstance) {
+			return;
+		}
+		pInstance->model = model;
+		pInstance->color = color;
+		pInstance->params = getInstanceParams();
+		recordMeshDraw3D(api, mesh, drawMode, baseInstance, 1, color.a < 1.f, transformBoundingSphere(model, mesh.bounds));
+	}
 
-	Allocator.Free(colors);
-	Allocator.Free(vertices);
 }
 
-void RenderApi3D::axisXYZ(glm::mat4 const* pModel) const {
+void RenderApi3D::buffer(const Buffer3D& buffer, eDrawMode drawMode, glm::mat4 const* pModel) const {
+	const glm::mat4 model = pModel ? *pModel : glm::identity<glm::mat4>();
+	// without color stream the vertex color is white, the uniform color goes in the instance
+	const bool hasColorStream = buffer.hasColors;
+	recordMeshDraw3D(*this, buffer, drawMode, model, hasColorStream ? glm::vec4(1.f) : buffer.uniformColor);
+}
 
-	glm::vec3 vertices[] = {
-		glm::vec3(0.f, 0.f, 0.f),
-		glm::vec3(1.f, 0.f, 0.f),
-		glm::vec3(0.f, 0.f, 0.f),
-		glm::vec3(0.f, 1.f, 0.f),
-		glm::vec3(0.f, 0.f, 0.f),
-		glm::vec3(0.f, 0.f, 1.f),
-	};
-	constexpr size_t vertexCount = COUNTOF(vertices);
-
-	glm::vec4 colors[] = {
-		glm::vec4(1.f, 0.f, 0.f, 1.f),
-		glm::vec4(1.f, 0.f, 0.f, 1.f),
-		glm::vec4(0.f, 1.f, 0.f, 1.f),
-		glm::vec4(0.f, 1.f, 0.f, 1.f),
-		glm::vec4(0.f, 0.f, 1.f, 1.f),
-		glm::vec4(0.f, 0.f, 1.f, 1.f),
-	};
+void RenderApi3D::lines(glm::vec3 const* vertices, unsigned int vertexCount, const glm::vec4& color, glm::mat4 const* pModel) const {
+	const glm::vec4 localBounds = computeBoundingSphere(vertices, GLsizei(vertexCount));
+	TransientVertex3D* transientVertices = recordTransientDraw3D(*this, eDrawMode::Lines, vertexCount, 0, pModel, color, false, localBounds).pVertices;
+	if (!transientVertices) {
+		return;
+	}
+	for (unsigned int i = 0; i < vertexCount; ++i) {
+		transientVertices[i] = { vertices[i], 0 };
+	}
+}
 
-	Buffer3D buffer3D;
+void RenderApi3D::grid(float size, unsigned int subdivisions, const glm::vec4& color, glm::mat4 const* pModel) const {
+	subdivisions = glm::max(subdivisions, 1u);
 
-	CreateBuffer3DParams createCubeBufferParams;
-	createCubeBufferParams.pVertices = vertices;
-	createCubeBufferParams.pNormals = nullptr;
-	createCubeBufferParams.pColors = colors;
-	createCubeBufferParams.vertexCount = vertexCount;
-	createBuffer3D(buffer3D, createCubeBufferParams);
+	const unsigned int vertexCount = 4 * (subdivisions + 1);
 
-	buffer(buffer3D, eDrawMode::Lines, pModel);
+	const glm::mat4 model = pModel ? *pModel : glm::identity<glm::mat4>();
 
-	deleteBuffer3D(buffer3D);
+	// the size goes with the shape parameters, the vertices are generated in the space of pModel
+	recordProceduralDraw3D(*this, eProceduralShape::Grid, subdivisions, glm::floatBitsToInt(size), eDrawMode::Lines, vertexCount, model, color, false,
+		size * glm::sqrt(0.5f));
 }
 
-void RenderApi3D::solidCube(float size, const glm::vec4& color, glm::mat4 const* pModel) const {
-	const float halfsize = size * 0.5f;
-	glm::vec3 edges[8] =
-	{
-		{ -halfsize, -halfsize, -halfsize},
-		{ +halfsize, -halfsize, -halfsize},
-		{ +halfsize, +halfsize, -halfsize},
-		{ -halfsize, +halfsize, -halfsize},
-		{ -halfsize, -halfsize, +halfsize},
-		{ +halfsize, -halfsize, +halfsize},
-		{ +halfsize, +halfsize, +halfsize},
-		{ -halfsize, +halfsize, +halfsize},
-	};
-
-	glm::vec3 faceNormals[6] =
-	{
-		{ 0, 0, -1 },
-		{ +1, 0, 0 },
-		{ 0, 0, +1 },
-		{ -1, 0, 0 },
-		{ 0, +1, 0 },
-		{ 0, -1, 0 },
-	};
-
-	int indices[36] =
-	{
-		0, 1, 3, 3, 1, 2,
-		1, 5, 2, 2, 5, 6,
-		5, 4, 6, 6, 4, 7,
-		4, 0, 7, 7, 0, 3,
-		3, 2, 7, 7, 2, 6,
-		4, 5, 0, 0, 5, 1
-	};
-
-	constexpr size_t vertexCount = 36;
-	float vertices[3 * vertexCount];
-	for (int i = 0; i < 36; i++) {
-		vertices[i * 3 + 0] = edges[indices[i]].x;
-		vertices[i * 3 + 1] = edges[indices[i]].y;
-		vertices[i * 3 + 2] = edges[indices[i]].z;
-	}
+void RenderApi3D::axisXYZ(glm::mat4 const* pModel) const {
 
-	float normals[3 * vertexCount];
-	for (int i = 0; i < 36; i++) {
-		normals[i * 3 + 0] = faceNormals[i / 6].x;
-		normals[i * 3 + 1] = faceNormals[i / 6].y;
-		normals[i * 3 + 2] = faceNormals[i / 6].z;
-	}
+	// one draw per axis, the color is per draw (the three draws end up in the same batch)
+	for (unsigned int iAxis = 0; iAxis < 3; ++iAxis) {
+		glm::vec4 color = glm::vec4(0.f, 0.f, 0.f, 1.f);
+		color[iAxis] = 1.f;
+		glm::vec3 axis = glm::vec3(0.f);
+		axis[iAxis] = 1.f;
 
-	glm::vec4 colors[vertexCount];
-	for (int iColor = 0; iColor < 6 * 6; ++iColor) {
-		colors[iColor] = color;
+		TransientVertex3D* vertices = recordTransientDraw3D(*this, eDrawMode::Lines, 2, 0, pModel, color, false, glm::vec4(0.5f * axis, 0.5f)).pVertices;
+		if (!vertices) {
+			continue;
+		}
+		vertices[0] = { glm::vec3(0.f), 0 };
+		vertices[1] = { axis, 0 };
 	}
+}
 
-	Buffer3D buffer3D;
-
-	CreateBuffer3DParams createCubeBufferParams;
-	createCubeBufferParams.pVertices = reinterpret_cast<glm::vec3*>(vertices);
-	createCubeBufferParams.pNormals = reinterpret_cast<glm::vec3*>(normals);
-	createCubeBufferParams.pColors = colors;
-	createCubeBufferParams.vertexCount = vertexCount;
-	createBuffer3D(buffer3D, createCubeBufferParams);
+void RenderApi3D::solidCube(float size, const glm::vec4& color, glm::mat4 const* pModel) const {
+	const Buffer3D& cubeMesh = getCubeMesh(*pRenderEngine);
 
-	buffer(buffer3D, eDrawMode::Triangles, pModel);
+	glm::mat4 model = pModel ? *pModel : glm::identity<glm::mat4>();
+	model = glm::scale(model, glm::vec3(size));
 
-	deleteBuffer3D(buffer3D);
+	// cached meshes have no color stream, the color is the instance color
+	recordMeshDraw3D(*this, cubeMesh, eDrawMode::Triangles, model, color);
 }
 
 void RenderApi3D::solidSphere(const glm::vec3& center, float radius, unsigned int horizontalSubdivisions, unsigned int verticalSubdivisions, const glm::vec4& color) const {
@@ -233,265 +317,192 @@ void RenderApi3D::solidSphere(const glm::vec3& center, float radius, unsigned in
 	horizontalSubdivisions = glm::max(horizontalSubdivisions, 4u);
 	verticalSubdivisions = glm::max(verticalSubdivisions, 2u);
 
-	const int vertexCount = 2 + horizontalSubdivisions * (verticalSubdivisions - 1);
+	const unsigned int vertexCount = 6 * horizontalSubdivisions * verticalSubdivisions;
 
-	glm::vec3* vertices = (glm::vec3*)Allocator.Allocate(sizeof(glm::vec3) * vertexCount);
-	glm::vec3* normals = (glm::vec3*)Allocator.Allocate(sizeof(glm::vec3) * vertexCount);
-	glm::vec4* colors = (glm::vec4*)Allocator.Allocate(sizeof(glm::vec4) * vertexCount);
+	glm::mat4 model = glm::translate(glm::identity<glm::mat4>(), center);
+	model = glm::scale(model, glm::vec3(radius));
 
-	int iVertex = 0;
-
-	const float verticalStep = glm::pi<float>() / verticalSubdivisions;
-	const float horizontalStep = glm::two_pi<float>() / horizontalSubdivisions;
-	for (unsigned int i = 1; i < verticalSubdivisions; ++i) {
-		const float verticalAngle = glm::half_pi<float>() - i * verticalStep;
+	recordProceduralDraw3D(*this, eProceduralShape::Sphere, horizontalSubdivisions, verticalSubdivisions, eDrawMode::Triangles, vertexCount, model, color, true, 1.f);
+}
 
-		const float xz = radius * glm::cos(verticalAngle);
-		const float y = radius * glm::sin(verticalAngle);
+void RenderApi3D::solidSpheres(glm::vec3 const* centers, float const* radii, glm::vec4 const* colors, unsigned int count, unsigned int horizontalSubdivisions, unsigned int verticalSubdivisions) const {
+	if (count == 0) {
+		return;
+	}
 
-		for (unsigned int j = 0; j < horizontalSubdivisions; ++j) {
-			const float horizontalAngle = j * horizontalStep;
-			const float x = xz * glm::cos(horizontalAngle);
-			const float z = xz * glm::sin(horizontalAngle);
+	horizontalSubdivisions = glm::max(horizontalSubdivisions, 4u);
+	verticalSubdivisions = glm::max(verticalSubdivisions, 2u);
 
+	const Buffer3D& sphereMesh = getSphereMesh(*pRenderEngine, horizontalSubdivisions, verticalSubdivisions);
+	const glm::ivec4 params = getInstanceParams();
 
-			vertices[iVertex] = center + glm::vec3(x, y, z);
-			normals[iVertex] = glm::vec3(x / radius, y / radius, z / radius);
-			colors[iVertex] = color;
-			iVertex++;
-		}
+	GLuint baseInstance;
+	InstanceData3D* instances = allocateInstances3D(*this, count, baseInstance);
+	if (!instances) {
+		return;
 	}
-
-	vertices[iVertex] = center + glm::vec3(0.f, radius, 0.f);
-	normals[iVertex] = glm::vec3(0.f, 1.f, 0.f);
-	colors[iVertex] = color;
-	iVertex++;
-
-	vertices[iVertex] = center + glm::vec3(0.f, -radius, 0.f);
-	normals[iVertex] = glm::vec3(0.f, -1.f, 0.f);
-	colors[iVertex] = color;
-	iVertex++;
-
-	const unsigned int indexCount = (2 * horizontalSubdivisions + (verticalSubdivisions - 2) * horizontalSubdivisions * 2) * 3;
-	unsigned int* indices = (unsigned int*)Allocator.Allocate(sizeof(unsigned int) * indexCount);
-
-	unsigned int iIndex = 0;
-	const int iFirstLine = 0;
-	for (unsigned int j = 0; j < horizontalSubdivisions; ++j) {
-		indices[iIndex++] = vertexCount - 2;
-		indices[iIndex++] = iFirstLine + j;
-		indices[iIndex++] = iFirstLine + ((j + 1) % horizontalSubdivisions);
-	}
-
-	for (unsigned int i = 0; i < verticalSubdivisions - 2; ++i) {
-		for (unsigned int j = 0; j < horizontalSubdivisions; ++j) {
-			const unsigned int iA = (i * horizontalSubdivisions) + j;
-			const unsigned int iB = (i * horizontalSubdivisions) + ((j + 1) % horizontalSubdivisions);
-			const unsigned int iC = ((i + 1) * horizontalSubdivisions) + j;
-			const unsigned int iD = ((i + 1) * horizontalSubdivisions) + ((j + 1) % horizontalSubdivisions);
-			indices[iIndex++] = iA;
-			indices[iIndex++] = iC;
-			indices[iIndex++] = iD;
-			indices[iIndex++] = iA;
-			indices[iIndex++] = iD;
-			indices[iIndex++] = iB;
-		}
-	}
-
-	const int iLastLine = (verticalSubdivisions - 2) * horizontalSubdivisions;
-	for (unsigned int j = 0; j < horizontalSubdivisions; ++j) {
-		indices[iIndex++] = vertexCount - 1;
-		indices[iIndex++] = iLastLine + j;
-		indices[iIndex++] = iLastLine + ((j + 1) % horizontalSubdivisions);
+	bool translucent = false;
+	InstanceBounds instanceBounds;
+	for (unsigned int i = 0; i < count; ++i) {
+		const float radius = radii[i];
+		glm::mat4& model = instances[i].model;
+		model = glm::mat4(radius);
+		model[3] = glm::vec4(centers[i], 1.f);
+		instances[i].color = colors[i];
+		instances[i].params = params;
+		translucent |= colors[i].a < 1.f;
+		addInstanceBounds(instanceBounds, glm::vec4(centers[i], radius));
 	}
 
-	Buffer3D buffer3D;
+	recordMeshDraw3D(*this, sphereMesh, eDrawMode::Triangles, baseInstance, count, translucent, getDrawBounds(instanceBounds));
+}
 
-	CreateBuffer3DParams createCubeBufferParams;
-	createCubeBufferParams.pVertices = vertices;
-	createCubeBufferParams.pNormals = normals;
-	createCubeBufferParams.pColors = colors;
-	createCubeBufferParams.pIndices = indices;
-	createCubeBufferParams.vertexCount = vertexCount;
-	createCubeBufferParams.indexCount = indexCount;
-	createBuffer3D(buffer3D, createCubeBufferParams);
+void RenderApi3D::solidCubes(glm::mat4 const* models, glm::vec4 const* colors, unsigned int count) const {
+	if (count == 0) {
+		return;
+	}
 
-	buffer(buffer3D, eDrawMode::Triangles, nullptr);
+	const Buffer3D& cubeMesh = getCubeMesh(*pRenderEngine);
+	const glm::ivec4 params = getInstanceParams();
 
-	deleteBuffer3D(buffer3D);
+	GLuint baseInstance;
+	InstanceData3D* instances = allocateInstances3D(*this, count, baseInstance);
+	if (!instances) {
+		return;
+	}
+	bool translucent = false;
+	InstanceBounds instanceBounds;
+	for (unsigned int i = 0; i < count; ++i) {
+		instances[i].model = models[i];
+		instances[i].color = colors[i];
+		instances[i].params = params;
+		translucent |= colors[i].a < 1.f;
+		addInstanceBounds(instanceBounds, transformBoundingSphere(models[i], cubeMesh.bounds));
+	}
 
-	Allocator.Free(indices);
-	Allocator.Free(colors);
-	Allocator.Free(normals);
-	Allocator.Free(vertices);
+	recordMeshDraw3D(*this, cubeMesh, eDrawMode::Triangles, baseInstance, count, translucent, getDrawBounds(instanceBounds));
 }
 
-void RenderApi3D::bone(const glm::vec3& childRelativePosition, const glm::vec4& color, const glm::quat& parentAbsoluteRotation, const glm::vec3& parentAbsolutePosition) const {
-	glm::vec3 newChildRelativePosition = childRelativePosition;
-
-	const float size = glm::length(childRelativePosition) / 10.f;
-
-	glm::vec3 front = glm::normalize(childRelativePosition);
-	glm::vec3 left;
-	glm::vec3 up;
-	const float frontDot = glm::dot(front, glm::vec3(0.f, 1.f, 0.f));
-	if (glm::abs(frontDot) != 1.f) {
-		left = glm::normalize(glm::cross(glm::vec3(0.f, 1.f, 0.f), front));
-		up = glm::normalize(glm::cross(front, left));
-	}
-	else {
-		up = glm::normalize(glm::cross(front, glm::vec3(1.f, 0.f, 0.f)));
-		left = glm::normalize(glm::cross(up, front));
-	}
-	up *= size;
-	front *= size;
-	left *= size;
-
-	up = parentAbsoluteRotation * glm::vec4(up, 0.f);
-	left = parentAbsoluteRotation * glm::vec4(left, 0.f);
-	front = parentAbsoluteRotation * glm::vec4(front, 0.f);
-	newChildRelativePosition = parentAbsoluteRotation * glm::vec4(newChildRelativePosition, 0.f);
-
-	glm::vec3 edges[] = {
-		parentAbsolutePosition,
-		parentAbsolutePosition + up + front,
-		parentAbsolutePosition - up + front,
-		parentAbsolutePosition + left + front,
-		parentAbsolutePosition - left + front,
-		parentAbsolutePosition + newChildRelativePosition,
-	};
+void RenderApi3D::sphereImpostors(glm::vec3 const* centers, float const* radii, glm::vec4 const* colors, unsigned int count) const {
+	if (count == 0) {
+		return;
+	}
 
-	unsigned int indices[] = {
-		0, 1, 3,
-		0, 4, 1,
-		0, 3, 2,
-		0, 2, 4,
-		5, 3, 1,
-		5, 1, 4,
-		5, 2, 3,
-		5, 4, 2,
-	};
-	const unsigned int vertexCount = COUNTOF(indices);
+	const glm::ivec4 params = getInstanceParams();
 
-	glm::vec3 vertices[vertexCount];
-	for (unsigned int i = 0; i < vertexCount; ++i) {
-		vertices[i] = edges[indices[i]];
+	GLuint baseInstance;
+	InstanceData3D* instances = allocateInstances3D(*this, count, baseInstance);
+	if (!instances) {
+		return;
 	}
-
-	glm::vec3 normals[vertexCount];
-	for (unsigned int i = 0; i < vertexCount; i += 3) {
-		glm::vec3 normal = glm::normalize(glm::cross(edges[indices[i + 1]] - edges[indices[i + 0]], edges[indices[i + 2]] - edges[indices[i + 0]]));
-		normals[i + 0] = normal;
-		normals[i + 1] = normal;
-		normals[i + 2] = normal;
+	bool translucent = false;
+	InstanceBounds instanceBounds;
+	for (unsigned int i = 0; i < count; ++i) {
+		const float radius = radii[i];
+		glm::mat4& model = instances[i].model;
+		model = glm::mat4(radius);
+		model[3] = glm::vec4(centers[i], 1.f);
+		instances[i].color = colors[i];
+		instances[i].params = params;
+		translucent |= colors[i].a < 1.f;
+		addInstanceBounds(instanceBounds, glm::vec4(centers[i], radius));
 	}
 
-	glm::vec4 colors[vertexCount];
-	for (unsigned int i = 0; i < vertexCount; ++i) {
-		colors[i] = color;
+	DrawCommand3D command;
+	// the impostors compute their normals, they are always lit
+	command.pShader = getFrameShader(*pRenderEngine, pRenderEngine->shadersSphereImpostor, ShaderPermutationLighting);
+	if (!command.pShader) {
+		return;
 	}
+	command.vao = pRenderEngine->impostorVao;
+	command.drawMode = GL_TRIANGLE_STRIP;
+	command.indexed = false;
+	command.count = 4;
+	command.first = 0;
+	command.baseVertex = 0;
+	command.instanceCount = count;
+	command.baseInstance = baseInstance;
+	command.translucent = translucent;
+	command.bounds = getDrawBounds(instanceBounds);
+	recordDrawCommand3D(pRenderEngine->drawCommands3D, command);
+}
 
-	Buffer3D buffer3D;
-
-	CreateBuffer3DParams createCubeBufferParams;
-	createCubeBufferParams.pVertices = vertices;
-	createCubeBufferParams.pNormals = normals;
-	createCubeBufferParams.pColors = colors;
-	createCubeBufferParams.vertexCount = vertexCount;
-	createBuffer3D(buffer3D, createCubeBufferParams);
-
-	buffer(buffer3D, eDrawMode::Triangles, nullptr);
-
-	deleteBuffer3D(buffer3D);
+void RenderApi3D::bone(const glm::vec3& childRelativePosition, const glm::vec4& color, const glm::quat& parentAbsoluteRotation, const glm::vec3& parentAbsolutePosition) const {
+	const Buffer3D& boneMesh = getBoneMesh(*pRenderEngine);
+	recordMeshDraw3D(*this, boneMesh, eDrawMode::Triangles, computeBoneModel(childRelativePosition, parentAbsoluteRotation, parentAbsolutePosition), color);
 }
 
-void RenderApi3D::horizontalPlane(const glm::vec3& center, const glm::vec2& size, unsigned int SideSubdivision, const glm::vec4& color) const {
-	unsigned int NbVertexBySide = SideSubdivision + 1;
-	unsigned int vertexCount = NbVertexBySide * NbVertexBySide;
-
-	glm::vec3* vertices = (glm::vec3*)Allocator.Allocate(sizeof(glm::vec3) * vertexCount);
-	glm::vec3* normals = (glm::vec3*)Allocator.Allocate(sizeof(glm::vec3) * vertexCount);
-	glm::vec4* colors = (glm::vec4*)Allocator.Allocate(sizeof(glm::vec4) * vertexCount);
-
-	unsigned int indiceCount = SideSubdivision * SideSubdivision * 6;
-	unsigned int* indices = (unsigned int*)Allocator.Allocate(sizeof(unsigned int) * indiceCount);
-
-	float fStepX = size.x / SideSubdivision;
-	float fStepZ = size.y / SideSubdivision;
-	glm::vec3& Start = glm::vec3(center.x - size.x * 0.5f, center.y, center.z - size.y * 0.5f);
-	for (unsigned int iVertexX = 0; iVertexX < NbVertexBySide; ++iVertexX) {
-		for (unsigned int iVertexZ = 0; iVertexZ < NbVertexBySide; ++iVertexZ) {
-			unsigned int Indice = iVertexX * NbVertexBySide + iVertexZ;
-			vertices[Indice] = { Start.x + iVertexX * fStepX, Start.y, Start.z + iVertexZ * fStepZ };
-			normals[Indice] = { 0.f, 1.f, 0.f };
-			colors[Indice] = color;
-		}
+void RenderApi3D::skeleton(int const* parentIndices, glm::quat const* worldRotations, glm::vec3 const* worldPositions, unsigned int boneCount, const glm::vec4& color) const {
+	unsigned int instanceCount = 0;
+	for (unsigned int i = 0; i < boneCount; ++i) {
+		instanceCount += isSkeletonBoneDrawn(parentIndices, worldPositions, boneCount, i);
 	}
+	if (instanceCount == 0) {
+		return;
+	}
+
+	const Buffer3D& boneMesh = getBoneMesh(*pRenderEngine);
+	const glm::ivec4 params = getInstanceParams();
 
-	for (unsigned int iSquareX = 0; iSquareX < SideSubdivision; ++iSquareX) {
-		for (unsigned int iSquareY = 0; iSquareY < SideSubdivision; ++iSquareY) {
-			unsigned int iVertexStart = iSquareX * NbVertexBySide + iSquareY;
-			unsigned int iIndiceStart = (iSquareX * SideSubdivision + iSquareY) * 6;
-			indices[iIndiceStart + 0] = iVertexStart;
-			indices[iIndiceStart + 1] = iVertexStart + 1;
-			indices[iIndiceStart + 2] = iVertexStart + NbVertexBySide + 1;
-			indices[iIndiceStart + 3] = iVertexStart;
-			indices[iIndiceStart + 4] = iVertexStart + NbVertexBySide + 1;
-			indices[iIndiceStart + 5] = iVertexStart + NbVertexBySide;
+	// one instance per bone from the parent joint to the child joint
+	GLuint baseInstance;
+	InstanceData3D* instances = allocateInstances3D(*this, instanceCount, baseInstance);
+	if (!instances) {
+		return;
+	}
+	unsigned int iInstance = 0;
+	InstanceBounds instanceBounds;
+	for (unsigned int i = 0; i < boneCount; ++i) {
+		if (!isSkeletonBoneDrawn(parentIndices, worldPositions, boneCount, i)) {
+			continue;
 		}
+		const int iParent = parentIndices[i];
+		const glm::quat& parentRotation = worldRotations[iParent];
+		const glm::vec3 childRelativePosition = glm::inverse(parentRotation) * (worldPositions[i] - worldPositions[iParent]);
+		const glm::mat4 model = computeBoneModel(childRelativePosition, parentRotation, worldPositions[iParent]);
+		instances[iInstance].model = model;
+		instances[iInstance].color = color;
+		instances[iInstance].params = params;
+		addInstanceBounds(instanceBounds, transformBoundingSphere(model, boneMesh.bounds));
+		++iInstance;
 	}
 
+	recordMeshDraw3D(*this, boneMesh, eDrawMode::Triangles, baseInstance, instanceCount, color.a < 1.f, getDrawBounds(instanceBounds));
+}
 
-	Buffer3D buffer3D;
-	CreateBuffer3DParams createCubeBufferParams;
-	createCubeBufferParams.pVertices = vertices;
-	createCubeBufferParams.pNormals = normals;
-	createCubeBufferParams.pColors = colors;
-	createCubeBufferParams.pIndices = indices;
-	createCubeBufferParams.vertexCount = vertexCount;
-	createCubeBufferParams.indexCount = indiceCount;
-	createBuffer3D(buffer3D, createCubeBufferParams);
-	buffer(buffer3D, eDrawMode::Triangles, nullptr);
+void RenderApi3D::horizontalPlane(const glm::vec3& center, const glm::vec2& size, unsigned int SideSubdivision, const glm::vec4& color) const {
+	SideSubdivision = glm::max(SideSubdivision, 1u);
 
-	deleteBuffer3D(buffer3D);
-	Allocator.Free(indices);
-	Allocator.Free(colors);
-	Allocator.Free(normals);
-	Allocator.Free(vertices);
+	const unsigned int vertexCount = 6 * SideSubdivision * SideSubdivision;
 
+	glm::mat4 model = glm::translate(glm::identity<glm::mat4>(), center);
+	model = glm::scale(model, glm::vec3(size.x, 1.f, size.y));
 
+	recordProceduralDraw3D(*this, eProceduralShape::Plane, SideSubdivision, SideSubdivision, eDrawMode::Triangles, vertexCount, model, color, true, glm::sqrt(0.5f));
 }
 
 void RenderApi2D::buffer(const Buffer2D& buffer, eDrawMode drawMode) const {
 	assert(buffer.vao); // did you call createDrawBuffer2D ?
-	glBindVertexArray(buffer.vao);
+	if (!buffer.hasColors) {
+		glVertexAttrib4fv(Buffer2D::BufferAttribColor, glm::value_ptr(buffer.uniformColor));
+	}
+	// keep the draw order with the primitives recorded before
+	flushDrawBatch2D(*pRenderEngine);
+	setVertexArray(pRenderEngine->glState, buffer.vao);
 	glDrawArrays((GLenum)drawMode, 0, buffer.vertexCount);
-	glBindVertexArray(0);
 }
 
 void RenderApi2D::lines(glm::vec2 const* vertices, unsigned int vertexCount, const glm::vec4& color) const {
-	glm::vec4* colors = new glm::vec4[vertexCount];
+	const unsigned int packedColor = glm::packUnorm4x8(color);
+	TransientVertex2D* transientVertices = appendVertices2D(pRenderEngine->drawBatch2D.lines, vertexCount);
 	for (unsigned int i = 0; i < vertexCount; ++i) {
-		colors[i] = color;
+		transientVertices[i] = { vertices[i], packedColor };
 	}
-
-	Buffer2D buffer2D;
-
-	CreateBuffer2DParams createBufferParams;
-	createBufferParams.pColors = colors;
-	createBufferParams.pVertices = vertices;
-	createBufferParams.vertexCount = vertexCount;
-	createBuffer2D(buffer2D, createBufferParams);
-
-	buffer(buffer2D, eDrawMode::Lines);
-
-	deleteBuffer2D(buffer2D);
-
-	delete[] colors;
 }
 
 void RenderApi2D::quadFill(const glm::vec2& min, const glm::vec2& max, const glm::vec4& color) const {
-	glm::vec2 vertices[] = {
+	const unsigned int packedColor = glm::packUnorm4x8(color);
+	const glm::vec2 vertices[] = {
 		{min.x, min.y},
 		{max.x, min.y},
 		{max.x, max.y},
@@ -501,22 +512,10 @@ void RenderApi2D::quadFill(const glm::vec2& min, const glm::vec2& max, const glm
 	};
 	constexpr unsigned int vertexCount = COUNTOF(vertices);
 
-	glm::vec4 colors[vertexCount];
-	for (unsigned int iColor = 0; iColor < vertexCount; ++iColor) {
-		colors[iColor] = color;
+	TransientVertex2D* transientVertices = appendVertices2D(pRenderEngine->drawBatch2D.triangles, vertexCount);
+	for (unsigned int i = 0; i < vertexCount; ++i) {
+		transientVertices[i] = { vertices[i], packedColor };
 	}
-
-	Buffer2D buffer2D;
-
-	CreateBuffer2DParams createSquareBufferParams;
-	createSquareBufferParams.pColors = colors;
-	createSquareBufferParams.pVertices = vertices;
-	createSquareBufferParams.vertexCount = vertexCount;
-	createBuffer2D(buffer2D, createSquareBufferParams);
-
-	buffer(buffer2D, eDrawMode::Triangles);
-
-	deleteBuffer2D(buffer2D);
 }
 
 void RenderApi2D::quadContour(const glm::vec2& min, const glm::vec2& max, const glm::vec4& color) const {
@@ -536,71 +535,48 @@ void RenderApi2D::quadContour(const glm::vec2& min, const glm::vec2& max, const
 }
 
 void RenderApi2D::circleFill(const glm::vec2& center, float radius, unsigned int subdivisions, const glm::vec4& color) const {
+	const unsigned int packedColor = glm::packUnorm4x8(color);
 	subdivisions = glm::max(subdivisions, 4u);
 
 	const unsigned int vertexCount = subdivisions * 3;
 
-	glm::vec2* vertices = new glm::vec2[vertexCount];
-	glm::vec4* colors = new glm::vec4[vertexCount];
+	TransientVertex2D* vertices = appendVertices2D(pRenderEngine->drawBatch2D.triangles, vertexCount);
+
+	glm::vec2 const* unitCircle = getUnitCircle2D(pRenderEngine->drawBatch2D, subdivisions);
 
 	int iVertex = 0;
 	glm::vec2 prev = { center.x + radius, center.y };
 	for (unsigned int i = 1; i <= subdivisions; ++i) {
-		const glm::vec2 current = {
-			center.x + radius * glm::cos(glm::two_pi<float>() * i / float(subdivisions)),
-			center.y + radius * glm::sin(glm::two_pi<float>() * i / float(subdivisions)),
-		};
-		vertices[iVertex++] = center;
-		vertices[iVertex++] = prev;
-		vertices[iVertex++] = current;
+		const glm::vec2 current = center + radius * unitCircle[i];
+		vertices[iVertex++] = { center, packedColor };
+		vertices[iVertex++] = { prev, packedColor };
+		vertices[iVertex++] = { current, packedColor };
 		prev = current;
 	}
-
-	for (unsigned int iColor = 0; iColor < vertexCount; ++iColor) {
-		colors[iColor] = color;
-	}
-
-	Buffer2D buffer2D;
-
-	CreateBuffer2DParams createSquareBufferParams;
-	createSquareBufferParams.pColors = colors;
-	createSquareBufferParams.pVertices = vertices;
-	createSquareBufferParams.vertexCount = vertexCount;
-	createBuffer2D(buffer2D, createSquareBufferParams);
-
-	buffer(buffer2D, eDrawMode::Triangles);
-
-	deleteBuffer2D(buffer2D);
-
-	delete[] vertices;
-	delete[] colors;
 }
 
 void RenderApi2D::circleContour(const glm::vec2& center, float radius, unsigned int subdivisions, const glm::vec4& color) const {
+	const unsigned int packedColor = glm::packUnorm4x8(color);
 	subdivisions = glm::max(subdivisions, 4u);
 
 	const unsigned int vertexCount = subdivisions * 2;
 
-	glm::vec2* vertices = new glm::vec2[vertexCount];
+	TransientVertex2D* vertices = appendVertices2D(pRenderEngine->drawBatch2D.lines, vertexCount);
 	
+	glm::vec2 const* unitCircle = getUnitCircle2D(pRenderEngine->drawBatch2D, subdivisions);
+
 	int iVertex = 0;
 	glm::vec2 prev = { center.x + radius, center.y };
 	for (unsigned int i = 1; i <= subdivisions; ++i) {
-		const glm::vec2 current = {
-			center.x + radius * glm::cos(glm::two_pi<float>() * i / float(subdivisions)),
-			center.y + radius * glm::sin(glm::two_pi<float>() * i / float(subdivisions)),
-		};
-		vertices[iVertex++] = prev;
-		vertices[iVertex++] = current;
+		const glm::vec2 current = center + radius * unitCircle[i];
+		vertices[iVertex++] = { prev, packedColor };
+		vertices[iVertex++] = { current, packedColor };
 		prev = current;
 	}
-
-	lines(vertices, vertexCount, color);
-
-	delete[] vertices;
 }
 
 void RenderApi2D::arrow(const glm::vec2& from, const glm::vec2& to, float thickness, float hatRatio /*between 0 and 1*/, const glm::vec4& color) const {
+	const unsigned int packedColor = glm::packUnorm4x8(color);
 
 	glm::vec2 dir = to - from;
 	const float length = glm::length(dir);
@@ -610,7 +586,7 @@ void RenderApi2D::arrow(const glm::vec2& from, const glm::vec2& to, float thickn
 	dir *= (length - hatSize);
 
 
-	glm::vec2 vertices[] = {
+	const glm::vec2 vertices[] = {
 		from - 0.5f * thickness * ortho,
 		from + 0.5f * thickness * ortho,
 		from + dir + 0.5f * thickness * ortho,
@@ -624,20 +600,8 @@ void RenderApi2D::arrow(const glm::vec2& from, const glm::vec2& to, float thickn
 
 	constexpr unsigned int vertexCount = COUNTOF(vertices);
 
-	glm::vec4 colors[vertexCount];
-	for (unsigned int iColor = 0; iColor < vertexCount; ++iColor) {
-		colors[iColor] = color;
+	TransientVertex2D* transientVertices = appendVertices2D(pRenderEngine->drawBatch2D.triangles, vertexCount);
+	for (unsigned int i = 0; i < vertexCount; ++i) {
+		transientVertices[i] = { vertices[i], packedColor };
 	}
-
-	Buffer2D buffer2D;
-
-	CreateBuffer2DParams createSquareBufferParams;
-	createSquareBufferParams.pColors = colors;
-	createSquareBufferParams.pVertices = vertices;
-	createSquareBufferParams.vertexCount = vertexCount;
-	createBuffer2D(buffer2D, createSquareBufferParams);
-
-	buffer(buffer2D, eDrawMode::Triangles);
-
-	deleteBuffer2D(buffer2D);
 }
\ No newline at end of file
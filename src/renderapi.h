@@ -6,7 +6,7 @@
 struct Buffer3D;
 struct Buffer2D;
 struct RenderEngine;
-struct ShaderProgram3D;
+struct ShaderVariants3D;
 
 enum class eDrawMode : GLenum {
 	Triangles = GL_TRIANGLES,
@@ -14,10 +14,14 @@ enum class eDrawMode : GLenum {
 	Points = GL_POINTS,
 };
 
+// draws are recorded and submitted at the end of the 3D pass (see DrawCommandList3D),
+// buffers given to buffer() must stay alive until then
 struct RenderApi3D {
-	RenderEngine const* pRenderEngine;
-	ShaderProgram3D const* pShader3D;
+	RenderEngine* pRenderEngine;
+	ShaderVariants3D* pShaders3D; // the regular or the custom programs, the draws pick the permutation
 
+	// the draw reads the vertices of buffer when the 3D pass ends, not during the call: the buffer must not be deleted before
+	// renderEngineFrame returns, and an update before then is what the draw shows (see updateBuffer3D)
 	void buffer(const Buffer3D& buffer, eDrawMode drawMode, glm::mat4 const* pModel) const;
 
 	// warning: if you want to draw A-B-C-D, then vertices should contain A-B-B-C-C-D 
@@ -31,13 +35,27 @@ struct RenderApi3D {
 
 	void solidSphere(const glm::vec3& center, float radius, unsigned int horizontalSubdivisions, unsigned int verticalSubdivisions, const glm::vec4& color) const;
 
+	// instanced versions: one upload of the per instance data and a single draw call for the whole batch
+	void solidSpheres(glm::vec3 const* centers, float const* radii, glm::vec4 const* colors, unsigned int count, unsigned int horizontalSubdivisions, unsigned int verticalSubdivisions) const;
+
+	void solidCubes(glm::mat4 const* models, glm::vec4 const* colors, unsigned int count) const;
+
+	// ray cast spheres: one camera facing quad per sphere instead of a tessellated mesh, exact silhouette, depth and normals.
+	// always drawn with the impostor program, the custom vertex shader does not apply
+	void sphereImpostors(glm::vec3 const* centers, float const* radii, glm::vec4 const* colors, unsigned int count) const;
+
 	void bone(const glm::vec3& childRelativePosition, const glm::vec4& color, const glm::quat& parentAbsoluteRotation, const glm::vec3& parentAbsolutePosition) const;
+
+	// all the bones of a rig in one draw: bone i goes from its parent joint to joint i, same shape as bone().
+	// the joints can come in any order, a root has a negative parent index (usually -1). roots and zero length bones are skipped,
+	// a parent index past boneCount asserts and its bone is skipped
+	void skeleton(int const* parentIndices, glm::quat const* worldRotations, glm::vec3 const* worldPositions, unsigned int boneCount, const glm::vec4& color) const;
 	
 	void horizontalPlane(const glm::vec3& center, const glm::vec2& size, unsigned int SideSubdivision, const glm::vec4& color) const;
 };
 
 struct RenderApi2D {
-	RenderEngine const* pRenderEngine;
+	RenderEngine* pRenderEngine;
 
 	void buffer(const Buffer2D& buffer, eDrawMode drawMode) const;
 
@@ -3,152 +3,611 @@
 #include "camera.h"
 #include "renderapi.h"
 
+#include <glm/common.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/constants.hpp>
 
+#include <stddef.h>
+#include <stdio.h>
+#include <assert.h>
+
+
+namespace {
+	constexpr GLsizeiptr TRANSIENT_BUFFER_FRAME_CAPACITY = 8 * 1024 * 1024;
+	constexpr GLsizeiptr CUSTOM_SHADER_DATA_CAPACITY = 64 * 1024; // grows with the payload
+	constexpr GLuint CUSTOM_SHADER_DATA_BINDING = 3; // see bufferData in shader_3d_custom.vert
+	constexpr GLuint FRAME_UNIFORMS_BINDING = 0; // see FrameData in the shaders
+
+	// (re)allocates the offscreen target when the viewport or the sample count changed and binds it.
+	// width and height receive the scaled resolution of the 3D passes
+	bool bindRenderTarget3D(RenderEngine& engine, const RenderParams& params, GLsizei& width, GLsizei& height) {
+		RenderTarget& target = engine.renderTarget3D;
+		const GLsizei samples = params.msaaSamples > 1 ? params.msaaSamples : 1;
+		if (target.width != params.viewportWidth || target.height != params.viewportHeight || target.samples != samples) {
+			deleteRenderTarget(target);
+			if (!createRenderTarget(target, params.viewportWidth, params.viewportHeight, samples)) {
+				return false;
+			}
+		}
+
+		DynamicResolution& resolution = engine.dynamicResolution;
+		if (params.frameTimeBudgetMs > 0.f) {
+			updateDynamicResolution(resolution, params.frameTimeMs, params.frameTimeBudgetMs);
+		}
+		else {
+			resolution = DynamicResolution();
+		}
+		width = glm::max(GLsizei(params.viewportWidth * resolution.scale + 0.5f), 1);
+		height = glm::max(GLsizei(params.viewportHeight * resolution.scale + 0.5f), 1);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+		return true;
+	}
+
+	void createTransientVertexArrays(RenderEngine& engine) {
+		glCreateVertexArrays(1, &engine.transientVao3D);
+		TransientVertexLayout3D::setupFormat(engine.transientVao3D);
+		// no color stream, the vertex color is the generic value and the color comes from the instance
+		setupInstanceAttributes(engine.transientVao3D);
+
+		glCreateVertexArrays(1, &engine.transientVao2D);
+		TransientVertexLayout2D::setupFormat(engine.transientVao2D);
+
+		glCreateVertexArrays(1, &engine.proceduralVao);
+		setupInstanceAttributes(engine.proceduralVao);
+
+		glCreateVertexArrays(1, &engine.impostorVao);
+		setupInstanceAttributes(engine.impostorVao);
+	}
+
+	// with parallel compilation every program the draws can use is issued at once, before anything waits for the driver: the builds
+	// overlap each other and the setup of the engine and of the scene, a draw is skipped until its program completes (see getShaderVariant3D).
+	// a driver that compiles on the calling thread would build permutations never drawn: only the unlit and lit programs of the
+	// regular draws (grid, lines, meshes) that nearly every scene uses are issued then, the others are left to their first use
+	void beginRenderEngineShaders(RenderEngine& engine) {
+		createShaderVariants3D(engine.shaders3D);
+		createShaderVariants3D_custom(engine.shaders3D_custom);
+		createShaderVariants3D_sphereImpostor(engine.shadersSphereImpostor);
+		beginShaderProgram2D(engine.shader2D);
+		if (!isParallelShaderCompileEnabled()) {
+			beginShaderVariant3D(engine.shaders3D, 0);
+			beginShaderVariant3D(engine.shaders3D, ShaderPermutationLighting);
+			return;
+		}
+		for (unsigned int permutation = 0; permutation < SHADER_PERMUTATION_COUNT; ++permutation) {
+			beginShaderVariant3D(engine.shaders3D, permutation);
+			beginShaderVariant3D(engine.shaders3D_custom, permutation);
+		}
+		beginShaderVariant3D(engine.shadersSphereImpostor, ShaderPermutationLighting);
+	}
+
+	void createUnitSphereBuffer(Buffer3D& buffer, BufferArena& arena, unsigned int horizontalSubdivisions, unsigned int verticalSubdivisions) {
+		const unsigned int vertexCount = 2 + horizontalSubdivisions * (verticalSubdivisions - 1);
+
+		glm::vec3* vertices = new glm::vec3[vertexCount];
+
+		unsigned int iVertex = 0;
+
+		const float verticalStep = glm::pi<float>() / verticalSubdivisions;
+		const float horizontalStep = glm::two_pi<float>() / horizontalSubdivisions;
+		for (unsigned int i = 1; i < verticalSubdivisions; ++i) {
+			const float verticalAngle = glm::half_pi<float>() - i * verticalStep;
+
+			const float xz = glm::cos(verticalAngle);
+			const float y = glm::sin(verticalAngle);
+
+			for (unsigned int j = 0; j < horizontalSubdivisions; ++j) {
+				const float horizontalAngle = j * horizontalStep;
+				vertices[iVertex++] = glm::vec3(xz * glm::cos(horizontalAngle), y, xz * glm::sin(horizontalAngle));
+			}
+		}
+
+		vertices[iVertex++] = glm::vec3(0.f, 1.f, 0.f);
+		vertices[iVertex++] = glm::vec3(0.f, -1.f, 0.f);
+
+		const unsigned int indexCount = (2 * horizontalSubdivisions + (verticalSubdivisions - 2) * horizontalSubdivisions * 2) * 3;
+		unsigned int* indices = new unsigned int[indexCount];
+
+		unsigned int iIndex = 0;
+		const unsigned int iFirstLine = 0;
+		for (unsigned int j = 0; j < horizontalSubdivisions; ++j) {
+			indices[iIndex++] = vertexCount - 2;
+			indices[iIndex++] = iFirstLine + j;
+			indices[iIndex++] = iFirstLine + ((j + 1) % horizontalSubdivisions);
+		}
+
+		for (unsigned int i = 0; i < verticalSubdivisions - 2; ++i) {
+			for (unsigned int j = 0; j < horizontalSubdivisions; ++j) {
+				const unsigned int iA = (i * horizontalSubdivisions) + j;
+				const unsigned int iB = (i * horizontalSubdivisions) + ((j + 1) % horizontalSubdivisions);
+				const unsigned int iC = ((i + 1) * horizontalSubdivisions) + j;
+				const unsigned int iD = ((i + 1) * horizontalSubdivisions) + ((j + 1) % horizontalSubdivisions);
+				indices[iIndex++] = iA;
+				indices[iIndex++] = iC;
+				indices[iIndex++] = iD;
+				indices[iIndex++] = iA;
+				indices[iIndex++] = iD;
+				indices[iIndex++] = iB;
+			}
+		}
+
+		const unsigned int iLastLine = (verticalSubdivisions - 2) * horizontalSubdivisions;
+		for (unsigned int j = 0; j < horizontalSubdivisions; ++j) {
+			indices[iIndex++] = vertexCount - 1;
+			indices[iIndex++] = iLastLine + j;
+			indices[iIndex++] = iLastLine + ((j + 1) % horizontalSubdivisions);
+		}
+
+		// on a unit sphere centered on the origin, normals are the positions
+		CreateBuffer3DParams createSphereBufferParams;
+		createSphereBufferParams.pVertices = vertices;
+		createSphereBufferParams.pNormals = vertices;
+		createSphereBufferParams.pColors = nullptr;
+		createSphereBufferParams.pIndices = indices;
+		createSphereBufferParams.vertexCount = vertexCount;
+		createSphereBufferParams.indexCount = indexCount;
+		createSphereBufferParams.positionFormat = ePositionFormat::Float16;
+		createSphereBufferParams.normalFormat = eNormalFormat::Int2_10_10_10;
+		createSphereBufferParams.pArena = &arena;
+		createBuffer3D(buffer, createSphereBufferParams);
+
+		delete[] indices;
+		delete[] vertices;
+	}
+
+	void createUnitCubeBuffer(Buffer3D& buffer, BufferArena& arena) {
+		const glm::vec3 faceNormals[6] =
+		{
+			{ 0, 0, -1 },
+			{ +1, 0, 0 },
+			{ 0, 0, +1 },
+			{ -1, 0, 0 },
+			{ 0, +1, 0 },
+			{ 0, -1, 0 },
+		};
+
+		// 4 vertices per face so that each face keeps its own normal
+		constexpr unsigned int vertexCount = 24;
+		glm::vec3 vertices[vertexCount];
+		glm::vec3 normals[vertexCount];
+
+		constexpr unsigned int indexCount = 36;
+		unsigned int indices[indexCount];
+
+		for (unsigned int iFace = 0; iFace < 6; ++iFace) {
+			const glm::vec3 normal = faceNormals[iFace];
+			const glm::vec3 u = glm::vec3(normal.y, normal.z, normal.x);
+			const glm::vec3 v = glm::cross(normal, u);
+			const glm::vec3 corners[4] = {
+				0.5f * (normal - u - v),
+				0.5f * (normal + u - v),
+				0.5f * (normal + u + v),
+				0.5f * (normal - u + v),
+			};
+			for (unsigned int iCorner = 0; iCorner < 4; ++iCorner) {
+				vertices[iFace * 4 + iCorner] = corners[iCorner];
+				normals[iFace * 4 + iCorner] = normal;
+			}
+			const unsigned int iFirst = iFace * 4;
+			indices[iFace * 6 + 0] = iFirst + 0;
+			indices[iFace * 6 + 1] = iFirst + 1;
+			indices[iFace * 6 + 2] = iFirst + 2;
+			indices[iFace * 6 + 3] = iFirst + 0;
+			indices[iFace * 6 + 4] = iFirst + 2;
+			indices[iFace * 6 + 5] = iFirst + 3;
+		}
+
+		CreateBuffer3DParams createCubeBufferParams;
+		createCubeBufferParams.pVertices = vertices;
+		createCubeBufferParams.pNormals = normals;
+		createCubeBufferParams.pColors = nullptr;
+		createCubeBufferParams.pIndices = indices;
+		createCubeBufferParams.vertexCount = vertexCount;
+		createCubeBufferParams.indexCount = indexCount;
+		createCubeBufferParams.positionFormat = ePositionFormat::Float16;
+		createCubeBufferParams.normalFormat = eNormalFormat::Int2_10_10_10;
+		createCubeBufferParams.pArena = &arena;
+		createBuffer3D(buffer, createCubeBufferParams);
+	}
+
+	void createUnitBoneBuffer(Buffer3D& buffer, BufferArena& arena) {
+		const glm::vec3 edges[] = {
+			{ 0.f, 0.f, 0.f },
+			{ 0.f, 1.f, 1.f },
+			{ 0.f, -1.f, 1.f },
+			{ 1.f, 0.f, 1.f },
+			{ -1.f, 0.f, 1.f },
+			{ 0.f, 0.f, 10.f },
+		};
+
+		const unsigned int faces[] = {
+			0, 1, 3,
+			0, 4, 1,
+			0, 3, 2,
+			0, 2, 4,
+			5, 3, 1,
+			5, 1, 4,
+			5, 2, 3,
+			5, 4, 2,
+		};
+
+		// 3 vertices per face so that each face keeps its own normal
+		constexpr unsigned int vertexCount = sizeof(faces) / sizeof(faces[0]);
+		glm::vec3 vertices[vertexCount];
+		glm::vec3 normals[vertexCount];
+		for (unsigned int i = 0; i < vertexCount; i += 3) {
+			const glm::vec3 normal = glm::normalize(glm::cross(edges[faces[i + 1]] - edges[faces[i + 0]], edges[faces[i + 2]] - edges[faces[i + 0]]));
+			for (unsigned int iCorner = 0; iCorner < 3; ++iCorner) {
+				vertices[i + iCorner] = edges[faces[i + iCorner]];
+				normals[i + iCorner] = normal;
+			}
+		}
+
+		CreateBuffer3DParams createBoneBufferParams;
+		createBoneBufferParams.pVertices = vertices;
+		createBoneBufferParams.pNormals = normals;
+		createBoneBufferParams.pColors = nullptr;
+		createBoneBufferParams.pIndices = nullptr;
+		createBoneBufferParams.vertexCount = vertexCount;
+		createBoneBufferParams.indexCount = 0;
+		createBoneBufferParams.positionFormat = ePositionFormat::Float16;
+		createBoneBufferParams.normalFormat = eNormalFormat::Int2_10_10_10;
+		createBoneBufferParams.pArena = &arena;
+		createBuffer3D(buffer, createBoneBufferParams);
+	}
+}
+
+void* allocateEngineTransient(RenderEngine& engine, GLsizeiptr size, GLsizeiptr alignment, GLintptr& offset) {
+	TransientBuffer& transientBuffer = engine.transientBuffer;
+	const GLsizeiptr frameCapacity = transientBuffer.frameCapacity;
+	void* pData = allocateTransient(transientBuffer, size, alignment, offset);
+	if (transientBuffer.frameCapacity != frameCapacity) {
+		invalidateGLStateObjects(engine.glState);
+	}
+	return pData;
+}
 
 bool createRenderEngine(RenderEngine& engine) {
-	if (!createShaderProgram3D(engine.shader3D)) {
+	engine.geometryCache.sphereCount = 0;
+	engine.geometryCache.nextSphereToEvict = 0;
+	engine.geometryCache.cube = Buffer3D();
+	engine.geometryCache.bone = Buffer3D();
+
+	beginRenderEngineShaders(engine);
+
+	engine.drawCommands3D.commands.clear();
+	engine.drawCommands3D.depthPlane = glm::vec4(0.f);
+	engine.drawCommands3D.recordedCount = 0;
+	engine.drawCommands3D.batchCount = 0;
+	engine.drawBatch2D.triangles.clear();
+	engine.drawBatch2D.lines.clear();
+	engine.waitForShaders = true;
+	engine.skippedDrawCount = 0;
+	engine.staticBatch3D = StaticBatch3D();
+	engine.bufferArena = BufferArena();
+	engine.renderTarget3D = RenderTarget();
+	engine.dynamicResolution = DynamicResolution();
+	createGpuTimer(engine.gpuTimer);
+
+	engine.transientBuffer = TransientBuffer();
+	if (!createTransientBuffer(engine.transientBuffer, TRANSIENT_BUFFER_FRAME_CAPACITY)) {
 		return false;
 	}
-	if (!createShaderProgram3D_custom(engine.shader3D_custom)) {
+	createTransientVertexArrays(engine);
+
+	engine.frameUniforms = PersistentStorageBuffer();
+	if (!createPersistentStorageBuffer(engine.frameUniforms, GL_UNIFORM_BUFFER, sizeof(FrameUniforms))) {
+		return false;
+	}
+	engine.customShaderData = PersistentStorageBuffer();
+	if (!createPersistentStorageBuffer(engine.customShaderData, GL_SHADER_STORAGE_BUFFER, CUSTOM_SHADER_DATA_CAPACITY)) {
 		return false;
 	}
-	if (!createShaderProgram2D(engine.shader2D)) {
+
+	if (!finishShaderProgram(engine.shader2D)) {
+		assert(false);
 		return false;
 	}
 	return true;
 }
 
+void deleteRenderEngine(RenderEngine& engine) {
+	GeometryCache& cache = engine.geometryCache;
+	for (unsigned int i = 0; i < cache.sphereCount; ++i) {
+		deleteBuffer3D(cache.spheres[i].buffer);
+	}
+	cache.sphereCount = 0;
+	if (cache.cube.vao) {
+		deleteBuffer3D(cache.cube);
+	}
+	if (cache.bone.vao) {
+		deleteBuffer3D(cache.bone);
+	}
+	deleteBufferArena(engine.bufferArena);
+
+	deleteStaticBatch3D(engine.staticBatch3D);
+	deleteRenderTarget(engine.renderTarget3D);
+	deleteGpuTimer(engine.gpuTimer);
+
+	glDeleteVertexArrays(1, &engine.transientVao3D);
+	glDeleteVertexArrays(1, &engine.transientVao2D);
+	glDeleteVertexArrays(1, &engine.proceduralVao);
+	glDeleteVertexArrays(1, &engine.impostorVao);
+	deleteTransientBuffer(engine.transientBuffer);
+	deletePersistentStorageBuffer(engine.frameUniforms);
+	deletePersistentStorageBuffer(engine.customShaderData);
+
+	deleteShaderVariants3D(engine.shaders3D);
+	deleteShaderVariants3D(engine.shaders3D_custom);
+	deleteShaderVariants3D(engine.shadersSphereImpostor);
+	deleteShaderProgram(engine.shader2D);
+}
+
+unsigned int getRenderEngineShaderPrograms(RenderEngine& engine, ShaderProgram* (&programs)[RENDER_ENGINE_MAX_PROGRAM_COUNT]) {
+	unsigned int programCount = 0;
+	programs[programCount++] = &engine.shader2D;
+	// the permutations never asked for have nothing to rebuild
+	for (ShaderVariants3D* pVariants : { &engine.shaders3D, &engine.shaders3D_custom, &engine.shadersSphereImpostor }) {
+		for (ShaderProgram3D& program : pVariants->programs) {
+			if (program.sourceKey != 0) {
+				programs[programCount++] = &program;
+			}
+		}
+	}
+	return programCount;
+}
+
+void replaceRenderEngineShaderProgram(RenderEngine& engine, ShaderProgram& program, const ShaderProgram& newProgram) {
+	// the draws refer to the program through the ShaderProgram, replacing the names in place is enough
+	deleteShaderProgram(program);
+	program = newProgram;
+	invalidateGLStateObjects(engine.glState);
+}
+
 bool reloadRenderEngineShaders(RenderEngine& engine) {
-	glDeleteProgram(engine.shader3D.programId);
-	glDeleteProgram(engine.shader3D_custom.programId);
-	glDeleteProgram(engine.shader2D.programId);
-	return createRenderEngine(engine);
+	ShaderProgram* programs[RENDER_ENGINE_MAX_PROGRAM_COUNT];
+	const unsigned int programCount = getRenderEngineShaderPrograms(engine, programs);
+	bool linked = true;
+	for (unsigned int i = 0; i < programCount; ++i) {
+		ShaderProgram* pProgram = programs[i];
+		ShaderProgram newProgram;
+		if (rebuildShaderProgram(*pProgram, newProgram)) {
+			replaceRenderEngineShaderProgram(engine, *pProgram, newProgram);
+		}
+		else if (newProgram.sourceKey != pProgram->sourceKey) {
+			linked = false;
+		}
+	}
+	return linked;
+}
+
+const Buffer3D& getSphereMesh(RenderEngine& engine, unsigned int horizontalSubdivisions, unsigned int verticalSubdivisions) {
+	GeometryCache& cache = engine.geometryCache;
+	for (unsigned int i = 0; i < cache.sphereCount; ++i) {
+		const SphereMesh& mesh = cache.spheres[i];
+		if (mesh.horizontalSubdivisions == horizontalSubdivisions && mesh.verticalSubdivisions == verticalSubdivisions) {
+			return mesh.buffer;
+		}
+	}
+
+	SphereMesh* pMesh;
+	if (cache.sphereCount < GeometryCache::MAX_SPHERE_MESHES) {
+		pMesh = &cache.spheres[cache.sphereCount++];
+	}
+	else {
+		unsigned int attemptCount = 0;
+		do {
+			pMesh = &cache.spheres[cache.nextSphereToEvict];
+			cache.nextSphereToEvict = (cache.nextSphereToEvict + 1) % GeometryCache::MAX_SPHERE_MESHES;
+			++attemptCount;
+		} while (pMesh->pinned && attemptCount < GeometryCache::MAX_SPHERE_MESHES);
+		assert(!pMesh->pinned); // every mesh is referenced by the static batch
+		// the recorded commands may still reference the evicted mesh
+		flushDrawCommands3D(engine);
+		deleteBuffer3D(pMesh->buffer);
+		// the vertex array may be bound and its name reused
+		invalidateGLStateObjects(engine.glState);
+	}
+
+	pMesh->horizontalSubdivisions = horizontalSubdivisions;
+	pMesh->verticalSubdivisions = verticalSubdivisions;
+	pMesh->pinned = false;
+	pMesh->buffer = Buffer3D();
+	createUnitSphereBuffer(pMesh->buffer, engine.bufferArena, horizontalSubdivisions, verticalSubdivisions);
+	return pMesh->buffer;
+}
+
+const Buffer3D& getCubeMesh(RenderEngine& engine) {
+	Buffer3D& cube = engine.geometryCache.cube;
+	if (cube.vao == 0) {
+		createUnitCubeBuffer(cube, engine.bufferArena);
+	}
+	return cube;
+}
+
+const Buffer3D& getBoneMesh(RenderEngine& engine) {
+	Buffer3D& bone = engine.geometryCache.bone;
+	if (bone.vao == 0) {
+		createUnitBoneBuffer(bone, engine.bufferArena);
+	}
+	return bone;
+}
+
+bool captureStaticBatch3D(RenderEngine& engine, Render3DCallback* callback, void* pUserData) {
+	assert(engine.drawCommands3D.commands.empty());
+	deleteStaticBatch3D(engine.staticBatch3D);
+	// the meshes of the previous capture can be evicted again, the new one pins its own
+	GeometryCache& cache = engine.geometryCache;
+	for (unsigned int i = 0; i < cache.sphereCount; ++i) {
+		cache.spheres[i].pinned = false;
+	}
+
+	// a region of its own, the capture must not be split by a flush or a wrap
+	TransientBuffer& transientBuffer = engine.transientBuffer;
+	beginTransientBufferFrame(transientBuffer);
+	GLintptr dataOffset;
+	allocateEngineTransient(engine, 0, StaticBatch3D::DATA_ALIGNMENT, dataOffset);
+	const unsigned int overflowCount = transientBuffer.overflowCount;
+	const unsigned int recordedCount = engine.drawCommands3D.recordedCount;
+
+	// a draw skipped by the capture would be missing until the next one
+	const bool waitForShaders = engine.waitForShaders;
+	engine.waitForShaders = true;
+	RenderApi3D api3D;
+	api3D.pShaders3D = &engine.shaders3D;
+	api3D.pRenderEngine = &engine;
+	callback(api3D, pUserData);
+	engine.waitForShaders = waitForShaders;
+
+	// a flush during the capture already submitted part of the commands
+	const bool complete = transientBuffer.overflowCount == overflowCount
+		&& engine.drawCommands3D.commands.size() == engine.drawCommands3D.recordedCount - recordedCount;
+	if (complete) {
+		for (const DrawCommand3D& command : engine.drawCommands3D.commands) {
+			for (unsigned int i = 0; i < cache.sphereCount; ++i) {
+				// the meshes of an arena block share their vertex array, baseVertex tells them apart
+				const Buffer3D& sphere = cache.spheres[i].buffer;
+				cache.spheres[i].pinned |= sphere.vao == command.vao && sphere.baseVertex == command.baseVertex && sphere.firstIndex == command.first;
+			}
+		}
+		const GLintptr dataEnd = transientBuffer.frameIndex * transientBuffer.frameCapacity + transientBuffer.frameOffset;
+		buildStaticBatch3D(engine, dataOffset, dataEnd - dataOffset);
+	}
+	else {
+		fprintf(stderr, "Static batch does not fit in the transient buffer, drawn every frame instead\n");
+		engine.drawCommands3D.commands.clear();
+	}
+	engine.drawCommands3D.recordedCount = recordedCount;
+
+	endTransientBufferFrame(transientBuffer);
+	return complete;
 }
 
-void renderEngineFrame(const RenderEngine& engine, const RenderParams& params) {
+void renderEngineFrame(RenderEngine& engine, const RenderParams& params) {
 	if(!params.viewportWidth || !params.viewportHeight) {
 		return;
 	}
-	glViewport(0, 0, params.viewportWidth, params.viewportHeight);
+	engine.waitForShaders = params.waitForShaders;
+	engine.skippedDrawCount = 0;
 
-	// Clear the front buffer
-	glClearColor(params.backgroundColor.r, params.backgroundColor.g, params.backgroundColor.b, params.backgroundColor.a);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	// camera, light and time of every program, uploaded once and bound for the whole frame
+	{
+		const Camera& camera = *params.pCamera;
+		glm::mat4 viewRot = glm::lookAt(glm::vec3(0,0,0), camera.o - camera.eye, camera.up);
+
+		FrameUniforms frame;
+		frame.view = glm::lookAt(camera.eye, camera.o, camera.up);
+		frame.projection = glm::perspective(camera.fov, params.viewportWidth / float(params.viewportHeight), 0.1f, 100.f);
+		frame.lightDir = glm::vec3(viewRot * params.lightDirection);
+		frame.lightStrength = params.lightStrength;
+		frame.ambient = params.lightAmbient;
+		frame.specular = params.specular;
+		frame.specularPow = params.specularPow;
+		frame.time = params.time;
+		frame.viewportSize = { float(params.viewportWidth), float(params.viewportHeight) };
+		frame.padding = glm::vec2(0.f); // the buffer compares the bytes with the previous frame
+
+		// -z of the view space position, orders the 3D draws by depth
+		engine.drawCommands3D.depthPlane = -glm::vec4(frame.view[0][2], frame.view[1][2], frame.view[2][2], frame.view[3][2]);
+		if (!updatePersistentStorageBuffer(engine.frameUniforms, &frame, sizeof(frame), FRAME_UNIFORMS_BINDING)) {
+			return;
+		}
+	}
+
+	beginGpuTimerFrame(engine.gpuTimer);
+	beginTransientBufferFrame(engine.transientBuffer);
+	engine.drawCommands3D.recordedCount = 0;
+	engine.drawCommands3D.batchCount = 0;
 
-	glPointSize(params.pointSize);
-	glLineWidth(params.lineWidth);
+	// the 3D passes go offscreen at a resolution that follows the frame time, or straight to the target when it is not asked for
+	GLsizei width3D = params.viewportWidth;
+	GLsizei height3D = params.viewportHeight;
+	const bool offscreen3D = (params.frameTimeBudgetMs > 0.f || params.msaaSamples > 1)
+		&& bindRenderTarget3D(engine, params, width3D, height3D);
+	if (!offscreen3D) {
+		glBindFramebuffer(GL_FRAMEBUFFER, params.targetFramebuffer);
+	}
+	const float scale3D = width3D / float(params.viewportWidth);
 
-	// save previous gl state
-	GLboolean bEnableBlend;
-	glGetBooleanv(GL_BLEND, &bEnableBlend);
-	GLint SrcFactorRGB;
-	glGetIntegerv(GL_BLEND_SRC_RGB, &SrcFactorRGB);
-	GLint DstFactorRGB;
-	glGetIntegerv(GL_BLEND_DST_RGB, &DstFactorRGB);
-	GLint SrcFactorAlpha;
-	glGetIntegerv(GL_BLEND_SRC_ALPHA, &SrcFactorAlpha);
-	GLint DstFactorAlpha;
-	glGetIntegerv(GL_BLEND_DST_ALPHA, &DstFactorAlpha);
+	// the clear is part of the 3D pass, the draws may also be submitted before the end of the callbacks (see allocateDrawData3D)
+	beginGpuTimerSection(engine.gpuTimer, GpuTimerSection3D);
+	glViewport(0, 0, width3D, height3D);
 
-	GLboolean bDepthTest;
-	glGetBooleanv(GL_DEPTH_TEST, &bDepthTest);
+	// Clear the front buffer
+	glClearColor(params.backgroundColor.r, params.backgroundColor.g, params.backgroundColor.b, params.backgroundColor.a);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	// set gl state
-	glEnable(GL_BLEND);
+	GLStateCache& glState = engine.glState;
+	beginGLStateCacheFrame(glState);
+	// in pixels of the 3D resolution, scaled to keep their size on screen
+	setPointSize(glState, params.pointSize * scale3D);
+	setLineWidth(glState, params.lineWidth * scale3D);
 
-	glBlendFuncSeparate(
+	// the state is left as set for the next frame, the cache knows it without glGet*.
+	// the 3D draws enable blending for the translucent ones only, see flushDrawCommands3D
+	setBlendFuncSeparate(glState,
 		GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,   // src/dst rgb
 		GL_ONE, GL_ONE_MINUS_SRC_ALPHA    // src/dst alpha
 	);
 
+	bool customShaderDataWritten = false;
+
 	// 3d
 	{
-		glEnable(GL_DEPTH_TEST);
-
-		const Camera& camera = *params.pCamera;
-		glm::mat4 projection = glm::perspective(camera.fov, params.viewportWidth / float(params.viewportHeight), 0.1f, 100.f);
-		glm::mat4 view = glm::lookAt(camera.eye, camera.o, camera.up);
-		glm::mat4 viewRot = glm::lookAt(glm::vec3(0,0,0), camera.o - camera.eye, camera.up);
-		glm::vec4 lightDirViewSpace = (viewRot * params.lightDirection);
-
-		const ShaderProgram3D& shader3D = engine.shader3D;
+		setDepthTestEnabled(glState, true);
 
-		glUseProgram(shader3D.programId);
-
-		glProgramUniformMatrix4fv(shader3D.programId, shader3D.viewLocation, 1, 0, glm::value_ptr(view));
-		glProgramUniformMatrix4fv(shader3D.programId, shader3D.projectionLocation, 1, 0, glm::value_ptr(projection));
-
-		glm::vec3 lightViewSpaceVec3 = glm::vec3(lightDirViewSpace);
-		glProgramUniform3fv(shader3D.programId, shader3D.lightDirLocation, 1, glm::value_ptr(lightViewSpaceVec3));
-		glProgramUniform1f(shader3D.programId, shader3D.lightStrengthLocation, params.lightStrength);
-		glProgramUniform1f(shader3D.programId, shader3D.ambientLocation, params.lightAmbient);
-		glProgramUniform1f(shader3D.programId, shader3D.specularLocation, params.specular);
-		glProgramUniform1f(shader3D.programId, shader3D.specularPowLocation, params.specularPow);
+		drawStaticBatch3D(engine);
 
 		RenderApi3D api3D;
-		api3D.pShader3D = &shader3D;
+		api3D.pShaders3D = &engine.shaders3D;
 		api3D.pRenderEngine = &engine;
+		if (!engine.staticBatch3D.captured && params.render3DStaticCallback) {
+			params.render3DStaticCallback(api3D, params.pRender3DStaticCallbackUserData);
+		}
 		params.render3DCallback(api3D, params.pRender3DCallbackUserData);
 
 		// 3D Custom vertex shader
-		const ShaderProgram3D_custom& shader3D_custom = engine.shader3D_custom;
-		glUseProgram(shader3D_custom.programId);
-		glProgramUniformMatrix4fv(shader3D_custom.programId, shader3D_custom.viewLocation, 1, 0, glm::value_ptr(view));
-		glProgramUniformMatrix4fv(shader3D_custom.programId, shader3D_custom.projectionLocation, 1, 0, glm::value_ptr(projection));
-	
-		glProgramUniform3fv(shader3D_custom.programId, shader3D_custom.lightDirLocation, 1, glm::value_ptr(lightViewSpaceVec3));
-		glProgramUniform1f(shader3D_custom.programId, shader3D_custom.lightStrengthLocation, params.lightStrength);
-		glProgramUniform1f(shader3D_custom.programId, shader3D_custom.ambientLocation, params.lightAmbient);
-		glProgramUniform1f(shader3D_custom.programId, shader3D_custom.specularLocation, params.specular);
-		glProgramUniform1f(shader3D_custom.programId, shader3D_custom.specularPowLocation, params.specularPow);
-		glProgramUniform1f(shader3D_custom.programId, shader3D_custom.timeLocation, params.time);
-		
-		GLuint ssbo = 0;
-		glGenBuffers(1, &ssbo);
-		if (params.pCustomVertShaderData != nullptr) {
-			glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
-			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, ssbo);
-			glBufferData(GL_SHADER_STORAGE_BUFFER, params.CustomVertShaderDataSize, params.pCustomVertShaderData, GL_DYNAMIC_COPY);
-		}
-		api3D.pShader3D = &shader3D_custom;
+		customShaderDataWritten = params.pCustomVertShaderData != nullptr && params.CustomVertShaderDataSize > 0
+			&& updatePersistentStorageBuffer(engine.customShaderData, params.pCustomVertShaderData, params.CustomVertShaderDataSize, CUSTOM_SHADER_DATA_BINDING);
+		api3D.pShaders3D = &engine.shaders3D_custom;
 		params.render3DCustomCallback(api3D, params.pRender3DCustomCallbackUserData);
-		glDeleteBuffers(1, &ssbo);
-		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		// both callbacks only recorded their draws, submit the whole pass while the custom data is still bound
+		flushDrawCommands3D(engine);
+		if (customShaderDataWritten) {
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CUSTOM_SHADER_DATA_BINDING, 0);
+		}
+		endGpuTimerSection(engine.gpuTimer, GpuTimerSection3D);
+	}
+
+	if (offscreen3D) {
+		beginGpuTimerSection(engine.gpuTimer, GpuTimerSectionUpscale);
+		blitRenderTarget(engine.renderTarget3D, width3D, height3D, params.targetFramebuffer, params.viewportWidth, params.viewportHeight);
+		glBindFramebuffer(GL_FRAMEBUFFER, params.targetFramebuffer);
+		glViewport(0, 0, params.viewportWidth, params.viewportHeight);
+		setPointSize(glState, params.pointSize);
+		setLineWidth(glState, params.lineWidth);
+		endGpuTimerSection(engine.gpuTimer, GpuTimerSectionUpscale);
 	}
 
 	// 2d
 	{
-		glDisable(GL_DEPTH_TEST);
-
-		const ShaderProgram2D& shader2D = engine.shader2D;
-
-		glUseProgram(shader2D.programId);
-
-		glm::vec2 viewportSize = {
-			float(params.viewportWidth),
-			float(params.viewportHeight),
-		};
-		glProgramUniform2fv(shader2D.programId, shader2D.viewportSizeLocation, 1, glm::value_ptr(viewportSize));
+		beginGpuTimerSection(engine.gpuTimer, GpuTimerSection2D);
+		setDepthTestEnabled(glState, false);
+		setBlendEnabled(glState, true);
+		setProgram(glState, engine.shader2D.programId);
 
 		RenderApi2D api2D;
 		api2D.pRenderEngine = &engine;
 		params.render2DCallback(api2D, params.pRender3DCallbackUserData);
+		flushDrawBatch2D(engine);
+		endGpuTimerSection(engine.gpuTimer, GpuTimerSection2D);
 	}
 
-	// restore gl state
-	if (bEnableBlend) {
-		glEnable(GL_BLEND);
-	}
-	else {
-		glDisable(GL_BLEND);
-	}
-
-	if (bDepthTest) {
-		glEnable(GL_DEPTH_TEST);
-	}
-	else {
-		glDisable(GL_DEPTH_TEST);
+	endTransientBufferFrame(engine.transientBuffer);
+	endPersistentStorageBufferFrame(engine.frameUniforms);
+	if (customShaderDataWritten) {
+		endPersistentStorageBufferFrame(engine.customShaderData);
 	}
 }
\ No newline at end of file
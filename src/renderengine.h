@@ -3,11 +3,24 @@
 #include <glad.h>
 
 #include "shader.h"
+#include "drawbuffer.h"
+#include "bufferarena.h"
+#include "transientbuffer.h"
+#include "persistentbuffer.h"
+#include "glstate.h"
+#include "rendertarget.h"
+#include "gputimer.h"
+#include "drawcommands.h"
 
 #include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
 
+#include <vector>
+#include <unordered_map>
+#include <stddef.h>
+
 struct RenderApi3D;
 struct RenderApi2D;
 struct Camera;
@@ -15,23 +28,170 @@ struct RenderParams;
 struct Buffer3D;
 struct Buffer2D;
 
+// unit sphere (center 0, radius 1) tessellated once per subdivision pair, without color stream
+struct SphereMesh {
+	unsigned int horizontalSubdivisions;
+	unsigned int verticalSubdivisions;
+	Buffer3D buffer;
+	bool pinned; // referenced by the static batch, never evicted
+};
+
+struct GeometryCache {
+	enum { MAX_SPHERE_MESHES = 16 };
+	SphereMesh spheres[MAX_SPHERE_MESHES];
+	unsigned int sphereCount;
+	unsigned int nextSphereToEvict; // round robin once the cache is full
+
+	Buffer3D cube; // unit cube (size 1) centered on the origin, without color stream
+	Buffer3D bone; // octahedron from the origin to (0, 0, 10), see getBoneMesh
+};
+
+// interleaved vertex formats of the immediate mode primitives, written in the transient buffer.
+// 3D primitives have a single color, it is sent as the instance color
+struct TransientVertex3D {
+	glm::vec3 position;
+	unsigned int normal; // GL_INT_2_10_10_10_REV, see glm::packSnorm3x10_1x2
+};
+
+using TransientVertexLayout3D = VertexLayout<eVertexLayout::Interleaved, AttribPosition3f, AttribNormal2_10_10_10>;
+static_assert(TransientVertexLayout3D::vertexSize == sizeof(TransientVertex3D) && offsetof(TransientVertex3D, normal) == TransientVertexLayout3D::attribOffset(1), "TransientVertex3D does not match its layout");
+
+// shape of the attribute-less primitives (InstanceData3D::params), the vertex shader generates their vertices from gl_VertexID
+enum class eProceduralShape : int {
+	None = 0,
+	Sphere, // params (horizontal subdivisions, vertical subdivisions), unit sphere, triangles, 6 * h * v vertices
+	Grid, // params (subdivisions, size as float bits), grid in the XZ plane, lines, 4 * (subdivisions + 1) vertices
+	Plane, // params (subdivisions, subdivisions), unit plane in the XZ plane facing +Y, triangles, 6 * subdivisions^2 vertices
+};
+
+struct TransientVertex2D {
+	glm::vec2 position;
+	unsigned int color; // RGBA8, see glm::packUnorm4x8
+};
+
+using TransientVertexLayout2D = VertexLayout<eVertexLayout::Interleaved, AttribPosition2f, AttribColor4ub<Buffer2D::BufferAttribColor>>;
+static_assert(TransientVertexLayout2D::vertexSize == sizeof(TransientVertex2D) && offsetof(TransientVertex2D, color) == TransientVertexLayout2D::attribOffset(1), "TransientVertex2D does not match its layout");
+
+// std140 mirror of the FrameData uniform block declared by every shader, written once per frame
+struct FrameUniforms {
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec3 lightDir; // view space
+	float lightStrength;
+	float ambient;
+	float specular;
+	float specularPow;
+	float time;
+	glm::vec2 viewportSize;
+	glm::vec2 padding;
+};
+
+static_assert(offsetof(FrameUniforms, lightDir) == 128 && offsetof(FrameUniforms, lightStrength) == 140
+	&& offsetof(FrameUniforms, viewportSize) == 160 && sizeof(FrameUniforms) == 176, "FrameUniforms does not follow the std140 layout of FrameData");
+
+// RenderApi2D primitives of the current pass, staged on the CPU and drawn with one draw per topology at the end of the pass
+struct DrawBatch2D {
+	std::vector<TransientVertex2D> triangles;
+	std::vector<TransientVertex2D> lines;
+
+	// cos/sin of the circle subdivisions, computed once per subdivision count
+	std::unordered_map<unsigned int, std::vector<glm::vec2>> unitCircles;
+};
+
+// sections of RenderEngine::gpuTimer
+enum eGpuTimerSection {
+	GpuTimerSection3D, // regular and custom 3D draws, submitted together by the deferred command list
+	GpuTimerSectionUpscale, // resolve and copy of the offscreen 3D passes
+	GpuTimerSection2D,
+	GpuTimerSectionImGui, // timed by the viewer, after renderEngineFrame
+	GpuTimerSectionCount
+};
+
 struct RenderEngine {
-	ShaderProgram3D shader3D;
-	ShaderProgram3D_custom shader3D_custom;
+	ShaderVariants3D shaders3D;
+	ShaderVariants3D shaders3D_custom;
 	ShaderProgram2D shader2D;
+	ShaderVariants3D shadersSphereImpostor;
+	bool waitForShaders; // of the current frame, see RenderParams::waitForShaders
+	unsigned int skippedDrawCount; // draws of the last frame dropped while their program was building, 0 for a complete frame
+
+	GeometryCache geometryCache;
+	// storage of the cached meshes, see CreateBuffer3DParams::pArena
+	BufferArena bufferArena;
+
+	// per frame streaming storage for immediate mode vertices/indices and instance data
+	TransientBuffer transientBuffer;
+	GLuint transientVao3D;
+	GLuint transientVao2D;
+	GLuint proceduralVao; // no vertex stream, only the per instance attributes
+	GLuint impostorVao; // no vertex stream, only the per instance attributes
+
+	// FrameUniforms, bound to FRAME_UNIFORMS_BINDING for the whole frame
+	PersistentStorageBuffer frameUniforms;
+
+	// RenderParams::pCustomVertShaderData, bound to CUSTOM_SHADER_DATA_BINDING
+	PersistentStorageBuffer customShaderData;
+
+	// RenderApi3D draws of the current pass, sorted and submitted at the end of the pass
+	DrawCommandList3D drawCommands3D;
+	DrawBatch2D drawBatch2D;
+
+	StaticBatch3D staticBatch3D;
+
+	// offscreen 3D passes, see RenderParams::frameTimeBudgetMs
+	RenderTarget renderTarget3D;
+	DynamicResolution dynamicResolution;
+
+	// bindings and pipeline state set by the engine, see GLStateCache
+	GLStateCache glState;
+
+	// GPU time of the passes (eGpuTimerSection), a few frames old
+	GpuTimer gpuTimer;
 };
 
+// allocateTransient in the transient buffer of the engine. the storage is reallocated when the request does not fit in a region,
+// the bindings cached in glState are then forgotten (the name of the new buffer can be the one of the deleted buffer).
+// nullptr when the storage cannot grow, the caller drops what it wanted to write
+void* allocateEngineTransient(RenderEngine& engine, GLsizeiptr size, GLsizeiptr alignment, GLintptr& offset);
+
 bool createRenderEngine(RenderEngine& engine);
+void deleteRenderEngine(RenderEngine& engine);
+
+enum { RENDER_ENGINE_MAX_PROGRAM_COUNT = 1 + 3 * SHADER_PERMUTATION_COUNT };
+
+// the programs of the engine a reload can replace (see rebuildShaderProgram): the 2D one and the 3D permutations
+// built so far, including the ones that failed to build. returns their count
+unsigned int getRenderEngineShaderPrograms(RenderEngine& engine, ShaderProgram* (&programs)[RENDER_ENGINE_MAX_PROGRAM_COUNT]);
+
+// program is one of getRenderEngineShaderPrograms, newProgram was built by rebuildShaderProgram. between two frames only
+void replaceRenderEngineShaderProgram(RenderEngine& engine, ShaderProgram& program, const ShaderProgram& newProgram);
+
+// rebuilds the programs whose files changed, on the calling thread. false when one of them does not link, it is then kept as is
 bool reloadRenderEngineShaders(RenderEngine& engine);
 
+// returns a GPU resident unit sphere, tessellated on first request
+const Buffer3D& getSphereMesh(RenderEngine& engine, unsigned int horizontalSubdivisions, unsigned int verticalSubdivisions);
+const Buffer3D& getCubeMesh(RenderEngine& engine);
+// the bone points along +Z, from the origin to (0, 0, 10), its widest section is the square (+-1, +-1) at z = 1
+const Buffer3D& getBoneMesh(RenderEngine& engine);
+
 
 using Render3DCallback = void (const RenderApi3D& api, void* pUserData);
 using Render2DCallback = void (const RenderApi2D& api, void* pUserData);
 
+// records the callback draws once (regular shader) and keeps them in the static batch, drawn at the start of every 3D pass.
+// static content is drawn before the other 3D draws, keep it opaque.
+// returns false when the capture does not fit in one transient buffer region, the engine then calls RenderParams::render3DStaticCallback every frame
+bool captureStaticBatch3D(RenderEngine& engine, Render3DCallback* callback, void* pUserData);
+
 struct RenderParams {
 	Render3DCallback* render3DCallback;
 	void* pRender3DCallbackUserData;
 
+	// only called while the static batch is not captured, see captureStaticBatch3D
+	Render3DCallback* render3DStaticCallback;
+	void* pRender3DStaticCallbackUserData;
+
 	Render3DCallback* render3DCustomCallback;
 	void* pRender3DCustomCallbackUserData;
 
@@ -43,6 +203,16 @@ struct RenderParams {
 	GLint viewportWidth;
 	GLint viewportHeight;
 
+	// the 3D passes render offscreen when frameTimeBudgetMs > 0 or msaaSamples > 1, their result is then copied (upscaled) to
+	// targetFramebuffer before the 2D pass. otherwise everything is drawn straight in targetFramebuffer
+	GLuint targetFramebuffer; // 0 for the default framebuffer, bound again when the frame returns
+	float frameTimeBudgetMs; // the 3D resolution drops while the frame time is above it, 0 keeps the full resolution
+	float frameTimeMs; // duration of the previous frame
+	GLsizei msaaSamples; // 1 without multisampling
+	// a draw whose program is still building waits for it. otherwise it is skipped until the build completes (see getShaderVariant3D),
+	// for frames that must be complete such as captures
+	bool waitForShaders;
+
 	float pointSize;
 	float lineWidth;
 
@@ -60,4 +230,4 @@ struct RenderParams {
 	unsigned int CustomVertShaderDataSize;
 };
 
-void renderEngineFrame(const RenderEngine& engine, const RenderParams& params);
\ No newline at end of file
+void renderEngineFrame(RenderEngine& engine, const RenderParams& params);
\ No newline at end of file
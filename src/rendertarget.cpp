@@ -0,0 +1,95 @@
+#include "rendertarget.h"
+
+#include <glm/common.hpp>
+#include <glm/exponential.hpp>
+
+#include <assert.h>
+#include <stdio.h>
+
+namespace {
+	constexpr float MIN_RESOLUTION_SCALE = 0.25f;
+
+	bool checkFramebuffer(GLuint fbo) {
+		const GLenum status = glCheckNamedFramebufferStatus(fbo, GL_FRAMEBUFFER);
+		if (status != GL_FRAMEBUFFER_COMPLETE) {
+			fprintf(stderr, "Render target incomplete, status 0x%x\n", status);
+			return false;
+		}
+		return true;
+	}
+
+	GLuint createRenderbuffer(GLenum format, GLsizei width, GLsizei height, GLsizei samples) {
+		GLuint renderbuffer;
+		glCreateRenderbuffers(1, &renderbuffer);
+		if (samples > 1) {
+			glNamedRenderbufferStorageMultisample(renderbuffer, samples, format, width, height);
+		}
+		else {
+			glNamedRenderbufferStorage(renderbuffer, format, width, height);
+		}
+		return renderbuffer;
+	}
+}
+
+bool createRenderTarget(RenderTarget& target, GLsizei width, GLsizei height, GLsizei samples) {
+	assert(target.fbo == 0); // trying to create a render target already initialized
+	target.width = width;
+	target.height = height;
+	target.samples = samples > 1 ? samples : 1;
+
+	glCreateFramebuffers(1, &target.fbo);
+	target.colorRenderbuffer = createRenderbuffer(GL_RGBA8, width, height, target.samples);
+	target.depthRenderbuffer = createRenderbuffer(GL_DEPTH_COMPONENT24, width, height, target.samples);
+	glNamedFramebufferRenderbuffer(target.fbo, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, target.colorRenderbuffer);
+	glNamedFramebufferRenderbuffer(target.fbo, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, target.depthRenderbuffer);
+	bool complete = checkFramebuffer(target.fbo);
+
+	if (target.samples > 1) {
+		// a multisample resolve cannot scale, it goes through a single sample copy of the same size
+		glCreateFramebuffers(1, &target.resolveFbo);
+		target.resolveRenderbuffer = createRenderbuffer(GL_RGBA8, width, height, 1);
+		glNamedFramebufferRenderbuffer(target.resolveFbo, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, target.resolveRenderbuffer);
+		complete = complete && checkFramebuffer(target.resolveFbo);
+	}
+
+	if (!complete) {
+		deleteRenderTarget(target);
+	}
+	return complete;
+}
+
+void deleteRenderTarget(RenderTarget& target) {
+	glDeleteFramebuffers(1, &target.fbo);
+	glDeleteFramebuffers(1, &target.resolveFbo);
+	glDeleteRenderbuffers(1, &target.colorRenderbuffer);
+	glDeleteRenderbuffers(1, &target.depthRenderbuffer);
+	glDeleteRenderbuffers(1, &target.resolveRenderbuffer);
+	target = RenderTarget();
+}
+
+void blitRenderTarget(const RenderTarget& target, GLsizei renderWidth, GLsizei renderHeight, GLuint dstFbo, GLsizei dstWidth, GLsizei dstHeight) {
+	GLuint srcFbo = target.fbo;
+	if (target.resolveFbo) {
+		glBlitNamedFramebuffer(target.fbo, target.resolveFbo, 0, 0, renderWidth, renderHeight, 0, 0, renderWidth, renderHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		srcFbo = target.resolveFbo;
+	}
+	const bool scaled = renderWidth != dstWidth || renderHeight != dstHeight;
+	glBlitNamedFramebuffer(srcFbo, dstFbo, 0, 0, renderWidth, renderHeight, 0, 0, dstWidth, dstHeight, GL_COLOR_BUFFER_BIT, scaled ? GL_LINEAR : GL_NEAREST);
+}
+
+void updateDynamicResolution(DynamicResolution& resolution, float frameTimeMs, float frameTimeBudgetMs) {
+	if (frameTimeMs <= 0.f || frameTimeBudgetMs <= 0.f) {
+		return;
+	}
+	// a single slow frame (loading, window resize) should not drop the resolution
+	resolution.smoothedFrameTimeMs = resolution.smoothedFrameTimeMs > 0.f
+		? glm::mix(resolution.smoothedFrameTimeMs, frameTimeMs, 0.1f)
+		: frameTimeMs;
+
+	// the frame time follows the pixel count, the scale is its square root. the dead band avoids oscillating around the budget
+	const float ratio = frameTimeBudgetMs / resolution.smoothedFrameTimeMs;
+	if (ratio < 0.95f || ratio > 1.1f) {
+		const float step = glm::clamp(glm::sqrt(ratio), 0.9f, 1.05f);
+		resolution.scale = glm::clamp(resolution.scale * step, MIN_RESOLUTION_SCALE, 1.f);
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <glad.h>
+
+// Offscreen color and depth attachments the 3D passes render into, allocated at the full viewport size.
+// A reduced resolution only uses the bottom left corner, changing the scale does not reallocate anything.
+// With samples > 1 the attachments are multisampled and resolved in resolveFbo before the upscale
+struct RenderTarget {
+	GLuint fbo = 0;
+	GLuint colorRenderbuffer = 0;
+	GLuint depthRenderbuffer = 0;
+	GLuint resolveFbo = 0; // 0 without multisampling
+	GLuint resolveRenderbuffer = 0;
+	GLsizei width = 0;
+	GLsizei height = 0;
+	GLsizei samples = 1;
+};
+
+bool createRenderTarget(RenderTarget& target, GLsizei width, GLsizei height, GLsizei samples);
+
+void deleteRenderTarget(RenderTarget& target);
+
+// copies the renderWidth x renderHeight corner of target to the whole dstWidth x dstHeight of dstFbo (0 for the default framebuffer).
+// only the color is copied
+void blitRenderTarget(const RenderTarget& target, GLsizei renderWidth, GLsizei renderHeight, GLuint dstFbo, GLsizei dstWidth, GLsizei dstHeight);
+
+// resolution scale of the 3D passes, follows the frame time to stay under a budget
+struct DynamicResolution {
+	float scale = 1.f; // of the width and height (never below 0.25), the pixel count is scale^2
+	float smoothedFrameTimeMs = 0.f; // 0 until the first update
+};
+
+// moves the scale toward the budget from the duration of the last frame, a frame time close to the budget leaves it as is
+void updateDynamicResolution(DynamicResolution& resolution, float frameTimeMs, float frameTimeBudgetMs);
@@ -4,10 +4,18 @@
 #include <assert.h>
 #include <string.h>
 
+#include <string>
+#include <vector>
+
 #ifndef SHADER_PATH
 #define SHADER_PATH
 #endif
 
+// directory of the program binary cache, the programs are always compiled from source without it
+#ifndef SHADER_CACHE_PATH
+#define SHADER_CACHE_PATH nullptr
+#endif
+
 namespace {
 	// No windows implementation of strsep
 	char* strsep_custom(char** stringp, const char* delim) {
@@ -34,7 +42,8 @@ namespace {
 		return nullptr;
 	}
 
-	int checkCompileError(GLuint shader, const char** sourceBuffer) {
+	// the source is only read back from the driver when there is a log to print
+	int checkCompileError(GLuint shader) {
 		// Get error log size and print it eventually
 		int logLength;
 		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logLength);
@@ -42,14 +51,20 @@ namespace {
 		{
 			char* log = new char[logLength];
 			glGetShaderInfoLog(shader, logLength, &logLength, log);
+			int sourceLength = 0;
+			glGetShaderiv(shader, GL_SHADER_SOURCE_LENGTH, &sourceLength);
+			char* source = new char[sourceLength + 1];
+			glGetShaderSource(shader, sourceLength + 1, nullptr, source);
+			source[sourceLength] = '\0';
 			char* token, * string;
-			string = _strdup(sourceBuffer[0]);
+			string = source;
 			int lc = 0;
 			while ((token = strsep_custom(&string, "\n")) != NULL) {
 				printf("%3d : %s\n", lc, token);
 				++lc;
 			}
 			fprintf(stderr, "Compile : %s", log);
+			delete[] source;
 			delete[] log;
 		}
 		// If an error happend quit
@@ -60,20 +75,22 @@ namespace {
 		return 0;
 	}
 
+	// the status is checked by checkCompileError, after the link is issued
 	GLuint compileShader(GLenum shaderType, const char* sourceBuffer, int bufferSize) {
 		GLuint shaderObject = glCreateShader(shaderType);
 		const char* sc[1] = { sourceBuffer };
-		glShaderSource(shaderObject, 1, sc, NULL);
+		const GLint lengths[1] = { bufferSize };
+		glShaderSource(shaderObject, 1, sc, lengths);
 		glCompileShader(shaderObject);
-		checkCompileError(shaderObject, sc);
 		return shaderObject;
 	}
 
-	GLuint compileShaderFromFile(GLenum shaderType, const char* path) {
+	// null terminated, nullptr when the file cannot be read. delete[] it
+	char* readShaderFile(const char* path) {
 		FILE* shaderFileDesc = fopen(path, "rb");
 		if (!shaderFileDesc) {
 			fprintf(stderr, "Failed to open file %s \n", path);
-			return 0;
+			return nullptr;
 		}
 
 		fseek(shaderFileDesc, 0, SEEK_END);
@@ -82,10 +99,8 @@ namespace {
 		char* buffer = new char[fileSize + 1];
 		fread(buffer, 1, fileSize, shaderFileDesc);
 		buffer[fileSize] = '\0';
-		GLuint shaderObject = compileShader(shaderType, buffer, fileSize);
-		delete[] buffer;
 		fclose(shaderFileDesc);
-		return shaderObject;
+		return buffer;
 	}
 
 	bool checkLinkError(GLuint program) {
@@ -104,77 +119,440 @@ namespace {
 			return false;
 		return true;
 	}
-}
 
-bool createShaderProgram(ShaderProgram& program, const CreateShaderProgramParams& params) {
-	// try to load and compile shaders
-	program.vertShaderId = compileShaderFromFile(GL_VERTEX_SHADER, params.szVertFilePath);
-	program.fragShaderId = compileShaderFromFile(GL_FRAGMENT_SHADER, params.szFragFilePath);
-	program.programId = glCreateProgram();
-	glAttachShader(program.programId, program.vertShaderId);
-	glAttachShader(program.programId, program.fragShaderId);
-	glLinkProgram(program.programId);
-	if (!checkLinkError(program.programId)) {
+	// Program binaries are only valid for the driver that produced them: the cache key covers the sources as compiled
+	// and the GL vendor, renderer and version strings. A binary the driver rejects anyway is replaced by a source build.
+	// There is one file per program (shader files and permutation), a program built from new sources overwrites its entry
+	const char* const shaderCachePath = SHADER_CACHE_PATH;
+
+	struct ProgramBinaryHeader {
+		enum : unsigned int { MAGIC = 0x42505347 }; // GSPB
+		unsigned int magic;
+		unsigned int format;
+		unsigned long long key; // the sourceKey of the binary, an entry of other sources is a miss
+		unsigned int length;
+	};
+
+	// larger than any program binary, a length above it is a corrupt file
+	constexpr long MAX_PROGRAM_BINARY_LENGTH = 64 * 1024 * 1024;
+
+	// FNV-1a 64, includes the null terminator so that consecutive strings cannot alias
+	unsigned long long hashString(unsigned long long hash, const char* str) {
+		for (const char* c = str; ; ++c) {
+			hash = (hash ^ (unsigned char)*c) * 0x100000001b3ull;
+			if (*c == '\0') {
+				return hash;
+			}
+		}
+	}
+
+	// in the order of the eShaderPermutation bits
+	const char* const permutationDefines[] = {
+		"SHADER_LIGHTING",
+		"SHADER_PROCEDURAL",
+	};
+	static_assert(sizeof(permutationDefines) / sizeof(permutationDefines[0]) == SHADER_PERMUTATION_BITS, "a permutation has no define");
+
+	constexpr unsigned int MAX_INCLUDE_DEPTH = 8;
+
+	// appends the file to source, its #include "name" lines replaced by the file name relative to its directory.
+	// a file is included once per stage, the #ifdef around an #include do not prevent the expansion
+	bool appendShaderFile(const std::string& path, std::string& source, std::vector<std::string>& includedPaths, unsigned int depth) {
+		char* buffer = readShaderFile(path.c_str());
+		if (!buffer) {
+			return false;
+		}
+		const std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+
+		bool read = true;
+		for (const char* line = buffer; *line && read; ) {
+			const char* lineEnd = strchr(line, '\n');
+			lineEnd = lineEnd ? lineEnd + 1 : line + strlen(line);
+			const char* directive = line + strspn(line, " \t");
+			if (strncmp(directive, "#include", 8) != 0) {
+				source.append(line, lineEnd);
+				line = lineEnd;
+				continue;
+			}
+
+			const char* nameBegin = strchr(directive, '"');
+			const char* nameEnd = nameBegin && nameBegin < lineEnd ? strchr(nameBegin + 1, '"') : nullptr;
+			if (!nameEnd || nameEnd >= lineEnd || depth == MAX_INCLUDE_DEPTH) {
+				fprintf(stderr, "Invalid #include in %s: %.*s\n", path.c_str(), int(lineEnd - line), line);
+				read = false;
+				break;
+			}
+			const std::string includePath = directory + std::string(nameBegin + 1, nameEnd);
+			bool included = false;
+			for (const std::string& includedPath : includedPaths) {
+				included = included || includedPath == includePath;
+			}
+			if (!included) {
+				includedPaths.push_back(includePath);
+				read = appendShaderFile(includePath, source, includedPaths, depth + 1);
+			}
+			line = lineEnd;
+		}
+		if (!source.empty() && source.back() != '\n') {
+			source += '\n';
+		}
+
+		delete[] buffer;
+		return read;
+	}
+
+	// the source as compiled: includes expanded and the defines of the permutation after the #version line, that must come first
+	bool preprocessShaderFile(const char* path, unsigned int permutation, std::string& source) {
+		std::vector<std::string> includedPaths;
+		source.clear();
+		if (!appendShaderFile(path, source, includedPaths, 0)) {
+			return false;
+		}
+
+		std::string defines;
+		for (unsigned int bit = 0; bit < SHADER_PERMUTATION_BITS; ++bit) {
+			if (permutation & (1u << bit)) {
+				defines += "#define ";
+				defines += permutationDefines[bit];
+				defines += '\n';
+			}
+		}
+		const size_t versionPos = source.find("#version");
+		const size_t insertPos = versionPos == std::string::npos ? 0 : source.find('\n', versionPos) + 1;
+		source.insert(insertPos, defines);
+		return true;
+	}
+
+	struct ShaderSources {
+		std::string vert;
+		std::string frag;
+	};
+
+	bool readShaderSources(const ShaderProgram& program, ShaderSources& sources) {
+		return preprocessShaderFile(program.szVertFilePath, program.permutation, sources.vert)
+			&& preprocessShaderFile(program.szFragFilePath, program.permutation, sources.frag);
+	}
+
+	// also tells whether a program has to be rebuilt
+	unsigned long long getShaderSourceKey(const ShaderSources& sources) {
+		unsigned long long key = 0xcbf29ce484222325ull;
+		key = hashString(key, sources.vert.c_str());
+		key = hashString(key, sources.frag.c_str());
+		key = hashString(key, (const char*)glGetString(GL_VENDOR));
+		key = hashString(key, (const char*)glGetString(GL_RENDERER));
+		key = hashString(key, (const char*)glGetString(GL_VERSION));
+		return key;
+	}
+
+	bool isProgramBinaryCacheEnabled() {
+		if (shaderCachePath == nullptr) {
+			return false;
+		}
+		GLint formatCount = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+		return formatCount > 0;
+	}
+
+	// the entry of the program, whatever its sources
+	void getProgramBinaryPath(const ShaderProgram& program, char (&path)[1024]) {
+		char permutation[16];
+		snprintf(permutation, sizeof(permutation), "%u", program.permutation);
+		unsigned long long nameKey = 0xcbf29ce484222325ull;
+		nameKey = hashString(nameKey, program.szVertFilePath);
+		nameKey = hashString(nameKey, program.szFragFilePath);
+		nameKey = hashString(nameKey, permutation);
+		snprintf(path, sizeof(path), "%s%016llx.bin", shaderCachePath, nameKey);
+	}
+
+	bool isProgramBinaryFormatSupported(GLenum format) {
+		GLint formatCount = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+		std::vector<GLint> formats(formatCount);
+		glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats.data());
+		for (GLint supportedFormat : formats) {
+			if (GLenum(supportedFormat) == format) {
+				return true;
+			}
+		}
 		return false;
 	}
 
-	return true;
-}
+	// the header of the entry when it is a binary of sourceKey in a supported format, of the length of the rest of the file
+	bool readProgramBinaryHeader(FILE* pFile, unsigned long long sourceKey, ProgramBinaryHeader& header) {
+		if (fseek(pFile, 0, SEEK_END) != 0) {
+			return false;
+		}
+		const long fileSize = ftell(pFile);
+		rewind(pFile);
+		return fileSize > long(sizeof(header))
+			&& fread(&header, sizeof(header), 1, pFile) == 1
+			&& header.magic == ProgramBinaryHeader::MAGIC
+			&& header.key == sourceKey
+			&& header.length <= MAX_PROGRAM_BINARY_LENGTH
+			&& long(header.length) == fileSize - long(sizeof(header))
+			&& isProgramBinaryFormatSupported(header.format);
+	}
 
-void	 ShaderProgram3D::LoadLocation() {
-	modelLocation = glGetUniformLocation(programId, "Model");
-	viewLocation = glGetUniformLocation(programId, "View");
-	projectionLocation = glGetUniformLocation(programId, "Projection");
-	lightDirLocation = glGetUniformLocation(programId, "LightDir");
-	lightStrengthLocation = glGetUniformLocation(programId, "LightStrength");
-	ambientLocation = glGetUniformLocation(programId, "Ambient");
-	specularLocation = glGetUniformLocation(programId, "Specular");
-	specularPowLocation = glGetUniformLocation(programId, "SpecularPow");
-	lightingEnabledLocation = glGetUniformLocation(programId, "LightingEnabled");
-}
+	// 0 on a miss, an entry the driver rejects is deleted
+	GLuint loadProgramBinary(const ShaderProgram& shaderProgram) {
+		char path[1024];
+		getProgramBinaryPath(shaderProgram, path);
+		FILE* pFile = fopen(path, "rb");
+		if (!pFile) {
+			return 0;
+		}
 
-bool createShaderProgram3D(ShaderProgram3D& program) {
-	CreateShaderProgramParams params;
-	params.szVertFilePath = SHADER_PATH "shader_3d.vert";
-	params.szFragFilePath = SHADER_PATH "shader_3d.frag";
-	if (!createShaderProgram(program, params)) {
-		assert(false);
+		GLuint program = 0;
+		bool rejected = false;
+		ProgramBinaryHeader header;
+		if (readProgramBinaryHeader(pFile, shaderProgram.sourceKey, header)) {
+			char* binary = new char[header.length];
+			if (fread(binary, 1, header.length, pFile) == header.length) {
+				program = glCreateProgram();
+				glProgramBinary(program, header.format, binary, header.length);
+				GLint status = GL_FALSE;
+				glGetProgramiv(program, GL_LINK_STATUS, &status);
+				if (status == GL_FALSE) {
+					glDeleteProgram(program);
+					program = 0;
+					rejected = true;
+				}
+			}
+			delete[] binary;
+		}
+		fclose(pFile);
+		if (rejected) {
+			remove(path);
+		}
+		return program;
+	}
+
+	void saveProgramBinary(const ShaderProgram& shaderProgram) {
+		const GLuint program = shaderProgram.programId;
+		GLint length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0) {
+			return;
+		}
+		char* binary = new char[length];
+		ProgramBinaryHeader header;
+		header.magic = ProgramBinaryHeader::MAGIC;
+		header.key = shaderProgram.sourceKey;
+		GLenum format = 0;
+		glGetProgramBinary(program, length, nullptr, &format, binary);
+		header.format = format;
+		header.length = (unsigned int)length;
+
+		char path[1024];
+		getProgramBinaryPath(shaderProgram, path);
+		FILE* pFile = fopen(path, "wb");
+		if (pFile) {
+			fwrite(&header, sizeof(header), 1, pFile);
+			fwrite(binary, 1, length, pFile);
+			fclose(pFile);
+		}
+		else {
+			fprintf(stderr, "Failed to write program binary %s \n", path);
+		}
+		delete[] binary;
+	}
+
+	// program.sourceKey is the key of sources. a cache hit skips the compilation and the link, there are no shader objects then.
+	// otherwise nothing waits for the driver, see finishShaderProgram
+	void issueShaderProgram(ShaderProgram& program, const ShaderSources& sources) {
+		const bool useCache = isProgramBinaryCacheEnabled();
+		if (useCache) {
+			program.programId = loadProgramBinary(program);
+			if (program.programId) {
+				return;
+			}
+		}
+
+		// try to load and compile shaders
+		program.vertShaderId = compileShader(GL_VERTEX_SHADER, sources.vert.c_str(), int(sources.vert.size()));
+		program.fragShaderId = compileShader(GL_FRAGMENT_SHADER, sources.frag.c_str(), int(sources.frag.size()));
+		program.programId = glCreateProgram();
+		glAttachShader(program.programId, program.vertShaderId);
+		glAttachShader(program.programId, program.fragShaderId);
+		if (useCache) {
+			glProgramParameteri(program.programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		}
+		glLinkProgram(program.programId);
+		program.linkPending = true;
+	}
+
+	typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSPROC)(GLuint count);
+	constexpr GLenum COMPLETION_STATUS = 0x91B1; // GL_COMPLETION_STATUS_KHR/ARB
+
+	bool parallelShaderCompileEnabled = false;
+
+	bool isExtensionSupported(const char* szExtension) {
+		GLint extensionCount = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+		for (GLint i = 0; i < extensionCount; ++i) {
+			if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), szExtension) == 0) {
+				return true;
+			}
+		}
 		return false;
 	}
+}
 
-	// Upload uniforms
-	program.LoadLocation();
+bool enableParallelShaderCompile(GLADloadproc loadProc) {
+	// not in the generated loader, the KHR and ARB extensions share the entry point but not its name
+	PFNGLMAXSHADERCOMPILERTHREADSPROC maxShaderCompilerThreads = nullptr;
+	if (isExtensionSupported("GL_KHR_parallel_shader_compile")) {
+		maxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSPROC)loadProc("glMaxShaderCompilerThreadsKHR");
+	}
+	else if (isExtensionSupported("GL_ARB_parallel_shader_compile")) {
+		maxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSPROC)loadProc("glMaxShaderCompilerThreadsARB");
+	}
+	if (!maxShaderCompilerThreads) {
+		return false;
+	}
+	// as many threads as the driver wants
+	maxShaderCompilerThreads(0xFFFFFFFF);
+	parallelShaderCompileEnabled = true;
 	return true;
 }
 
-void	 ShaderProgram3D_custom::LoadLocation() {
-	ShaderProgram3D::LoadLocation();
-	timeLocation = glGetUniformLocation(programId, "Time");
+bool isParallelShaderCompileEnabled() {
+	return parallelShaderCompileEnabled;
 }
 
-bool createShaderProgram3D_custom(ShaderProgram3D_custom& program) {
-	CreateShaderProgramParams params;
-	params.szVertFilePath = SHADER_PATH "shader_3d_custom.vert";
-	params.szFragFilePath = SHADER_PATH "shader_3d.frag";
-	if (!createShaderProgram(program, params)) {
-		assert(false);
+bool isShaderProgramBuilt(const ShaderProgram& program) {
+	if (!program.linkPending || !parallelShaderCompileEnabled) {
+		return true;
+	}
+	// the link completes after the compilations
+	GLint completed = GL_FALSE;
+	glGetProgramiv(program.programId, COMPLETION_STATUS, &completed);
+	return completed != GL_FALSE;
+}
+
+bool beginShaderProgram(ShaderProgram& program, const CreateShaderProgramParams& params) {
+	program = ShaderProgram();
+	program.szVertFilePath = params.szVertFilePath;
+	program.szFragFilePath = params.szFragFilePath;
+	program.permutation = params.permutation;
+
+	ShaderSources sources;
+	if (!readShaderSources(program, sources)) {
 		return false;
 	}
-	// Upload uniforms
-	program.LoadLocation();
+	program.sourceKey = getShaderSourceKey(sources);
+	issueShaderProgram(program, sources);
 	return true;
 }
 
-bool createShaderProgram2D(ShaderProgram2D& program) {
-	CreateShaderProgramParams params;
-	params.szVertFilePath = SHADER_PATH "shader_2d.vert";
-	params.szFragFilePath = SHADER_PATH "shader_2d.frag";
-	if (!createShaderProgram(program, params)) {
-		assert(false);
+bool finishShaderProgram(ShaderProgram& program) {
+	if (!program.linkPending) {
+		return program.programId != 0;
+	}
+	program.linkPending = false;
+
+	// the first status query waits for the driver
+	checkCompileError(program.vertShaderId);
+	checkCompileError(program.fragShaderId);
+	const bool linked = checkLinkError(program.programId);
+	if (linked && isProgramBinaryCacheEnabled()) {
+		saveProgramBinary(program);
+	}
+	if (!linked) {
+		deleteShaderProgram(program);
+	}
+	return linked;
+}
+
+bool createShaderProgram(ShaderProgram& program, const CreateShaderProgramParams& params) {
+	return beginShaderProgram(program, params) && finishShaderProgram(program);
+}
+
+bool rebuildShaderProgram(const ShaderProgram& program, ShaderProgram& newProgram) {
+	newProgram = ShaderProgram();
+	newProgram.szVertFilePath = program.szVertFilePath;
+	newProgram.szFragFilePath = program.szFragFilePath;
+	newProgram.permutation = program.permutation;
+
+	ShaderSources sources;
+	if (!readShaderSources(newProgram, sources)) {
+		return false;
+	}
+	newProgram.sourceKey = getShaderSourceKey(sources);
+	if (newProgram.sourceKey == program.sourceKey) {
 		return false;
 	}
+	issueShaderProgram(newProgram, sources);
+	return finishShaderProgram(newProgram);
+}
 
-	program.viewportSizeLocation = glGetUniformLocation(program.programId, "ViewportSize");
+void deleteShaderProgram(ShaderProgram& program) {
+	glDeleteProgram(program.programId);
+	glDeleteShader(program.vertShaderId);
+	glDeleteShader(program.fragShaderId);
+	program.vertShaderId = 0;
+	program.fragShaderId = 0;
+	program.programId = 0;
+	program.linkPending = false;
+}
 
-	return true;
+const char* getShaderDirectory() {
+	return SHADER_PATH;
+}
+
+namespace {
+	void initShaderVariants3D(ShaderVariants3D& variants, char const* szVertFilePath, char const* szFragFilePath) {
+		variants.files.szVertFilePath = szVertFilePath;
+		variants.files.szFragFilePath = szFragFilePath;
+		for (ShaderProgram3D& program : variants.programs) {
+			program = ShaderProgram3D();
+		}
+	}
+}
+
+void createShaderVariants3D(ShaderVariants3D& variants) {
+	initShaderVariants3D(variants, SHADER_PATH "shader_3d.vert", SHADER_PATH "shader_3d.frag");
+}
+
+void createShaderVariants3D_custom(ShaderVariants3D& variants) {
+	initShaderVariants3D(variants, SHADER_PATH "shader_3d_custom.vert", SHADER_PATH "shader_3d.frag");
+}
+
+void createShaderVariants3D_sphereImpostor(ShaderVariants3D& variants) {
+	initShaderVariants3D(variants, SHADER_PATH "shader_sphere_impostor.vert", SHADER_PATH "shader_sphere_impostor.frag");
+}
+
+void deleteShaderVariants3D(ShaderVariants3D& variants) {
+	for (ShaderProgram3D& program : variants.programs) {
+		deleteShaderProgram(program);
+	}
+}
+
+void beginShaderVariant3D(ShaderVariants3D& variants, unsigned int permutation) {
+	assert(permutation < SHADER_PERMUTATION_COUNT);
+	ShaderProgram3D& program = variants.programs[permutation];
+	if (program.programId == 0 && program.sourceKey == 0) {
+		CreateShaderProgramParams params = variants.files;
+		params.permutation = permutation;
+		if (!beginShaderProgram(program, params)) {
+			program.sourceKey = ~0ull;
+		}
+	}
+}
+
+ShaderProgram3D const* getShaderVariant3D(ShaderVariants3D& variants, unsigned int permutation, bool wait) {
+	beginShaderVariant3D(variants, permutation);
+	// a failed build keeps its key, a reload rebuilds the permutation once its files change
+	ShaderProgram3D& program = variants.programs[permutation];
+	if (wait || isShaderProgramBuilt(program)) {
+		finishShaderProgram(program);
+	}
+	return program.programId && !program.linkPending ? &program : nullptr;
+}
+
+bool beginShaderProgram2D(ShaderProgram2D& program) {
+	CreateShaderProgramParams params;
+	params.szVertFilePath = SHADER_PATH "shader_2d.vert";
+	params.szFragFilePath = SHADER_PATH "shader_2d.frag";
+	return beginShaderProgram(program, params);
 }
@@ -2,45 +2,99 @@
 
 #include <glad.h>
 
+// compile time specializations of a program: each bit adds its #define right after the #version line of both stages,
+// so that a draw runs code without branches on what it does not use
+enum eShaderPermutation : unsigned int {
+	ShaderPermutationLighting = 1 << 0, // SHADER_LIGHTING: shaded with the light of the frame, the vertices need normals
+	ShaderPermutationProcedural = 1 << 1, // SHADER_PROCEDURAL: the vertices may be generated from gl_VertexID (see eProceduralShape)
+};
+
+enum {
+	SHADER_PERMUTATION_BITS = 2,
+	SHADER_PERMUTATION_COUNT = 1 << SHADER_PERMUTATION_BITS,
+};
+
+// the shader files may #include "name" files of their directory, expanded before the permutation defines apply
 struct ShaderProgram {
-	GLuint vertShaderId;
-	GLuint fragShaderId;
-	GLuint programId;
+	GLuint vertShaderId = 0; // 0 for a program loaded from the binary cache
+	GLuint fragShaderId = 0;
+	GLuint programId = 0;
+
+	// read again by rebuildShaderProgram
+	char const* szVertFilePath = nullptr;
+	char const* szFragFilePath = nullptr;
+	unsigned int permutation = 0; // eShaderPermutation bits
+	unsigned long long sourceKey = 0; // of the sources (includes expanded, permutation defines) and the driver the program was built from
+	bool linkPending = false; // compiled and linked, the status is not checked yet (see finishShaderProgram)
 };
 
 struct CreateShaderProgramParams {
-	char const* szVertFilePath;
+	char const* szVertFilePath; // must outlive the program
 	char const* szFragFilePath;
+	unsigned int permutation = 0;
 };
 
+// lets the driver compile and link on threads of its own (GL_KHR_parallel_shader_compile or GL_ARB_parallel_shader_compile),
+// the programs issued one after the other with beginShaderProgram then build concurrently. false when the driver has neither
+bool enableParallelShaderCompile(GLADloadproc loadProc);
+
+// enableParallelShaderCompile succeeded
+bool isParallelShaderCompileEnabled();
+
+// finishShaderProgram would not wait for the driver (GL_COMPLETION_STATUS_KHR). always true without parallel compilation,
+// the driver cannot tell then
+bool isShaderProgramBuilt(const ShaderProgram& program);
+
+// reads the files and issues the compilation and the link without waiting for them. false when the files cannot be read
+bool beginShaderProgram(ShaderProgram& program, const CreateShaderProgramParams& params);
+
+// checks the status of a program issued by beginShaderProgram, waits for the driver if it is not done.
+// false when it does not link, the program then holds no GL object
+bool finishShaderProgram(ShaderProgram& program);
+
+// beginShaderProgram and finishShaderProgram
 bool createShaderProgram(ShaderProgram& program, const CreateShaderProgramParams& params);
 
+// builds newProgram from the files of program when they no longer match the sources program was built from.
+// false when they did not change or the new program does not link, newProgram then holds no GL object
+bool rebuildShaderProgram(const ShaderProgram& program, ShaderProgram& newProgram);
+
+// also deletes the shader objects
+void deleteShaderProgram(ShaderProgram& program);
+
+// SHADER_PATH, where the files of the programs of the engine are
+const char* getShaderDirectory();
+
+// the camera, lighting and time uniforms of every program come from the FrameData uniform block (see FrameUniforms),
+// the model matrix, color and flags of a draw from its instance data: the programs have no uniform to set
 struct ShaderProgram3D : ShaderProgram {
-	GLuint modelLocation;
-	GLuint viewLocation;
-	GLuint projectionLocation;
-	GLuint lightDirLocation;
-	GLuint lightStrengthLocation;
-	GLuint ambientLocation;
-	GLuint specularLocation;
-	GLuint specularPowLocation;
-	GLuint lightingEnabledLocation;
-
-	void	 LoadLocation();
 };
 
-bool createShaderProgram3D(ShaderProgram3D& program);
-
-struct ShaderProgram3D_custom : ShaderProgram3D {
-	GLuint timeLocation;
-	void	 LoadLocation();
+// the files of a 3D program and the programs built from them, one per permutation, on first use
+struct ShaderVariants3D {
+	CreateShaderProgramParams files;
+	ShaderProgram3D programs[SHADER_PERMUTATION_COUNT]; // no programId until used, a sourceKey and no programId when it did not build
 };
 
-bool createShaderProgram3D_custom(ShaderProgram3D_custom& program);
+// nothing is compiled until getShaderVariant3D
+void createShaderVariants3D(ShaderVariants3D& variants);
+// shader_3d_custom.vert and the fragment shader of createShaderVariants3D
+void createShaderVariants3D_custom(ShaderVariants3D& variants);
+// ray cast spheres drawn as camera facing quads, same inputs as createShaderVariants3D
+void createShaderVariants3D_sphereImpostor(ShaderVariants3D& variants);
+
+void deleteShaderVariants3D(ShaderVariants3D& variants);
+
+// issues the build of the permutation ahead of its first use, does nothing when it was already issued
+void beginShaderVariant3D(ShaderVariants3D& variants, unsigned int permutation);
+
+// issues the build of the permutation the first time it is asked for. with parallel compilation and wait false, nullptr while
+// the build is running: the draw is skipped until it completes. otherwise waits for the build.
+// nullptr when it does not build, it is not tried again until its files change (see rebuildShaderProgram)
+ShaderProgram3D const* getShaderVariant3D(ShaderVariants3D& variants, unsigned int permutation, bool wait);
 
 struct ShaderProgram2D : ShaderProgram {
-	GLuint viewportSizeLocation;
 };
 
-bool createShaderProgram2D(ShaderProgram2D& program);
-
+// issues the build, see finishShaderProgram
+bool beginShaderProgram2D(ShaderProgram2D& program);
@@ -0,0 +1,119 @@
+#include "shaderreloader.h"
+#include "renderengine.h"
+
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#include <assert.h>
+#include <stdio.h>
+
+namespace {
+	void runShaderReloaderWorker(ShaderReloader* pReloader) {
+		ShaderReloader& reloader = *pReloader;
+		glfwMakeContextCurrent(reloader.pWorkerWindow);
+
+		std::unique_lock<std::mutex> lock(reloader.mutex);
+		for (;;) {
+			reloader.jobQueued.wait(lock, [&reloader] { return reloader.quit || !reloader.jobs.empty(); });
+			if (reloader.quit) {
+				break;
+			}
+			ShaderReloader::Job job = reloader.jobs.back();
+			reloader.jobs.pop_back();
+			lock.unlock();
+
+			ShaderReloader::Result result;
+			result.pProgram = job.pProgram;
+			rebuildShaderProgram(job.program, result.newProgram);
+			// the main context only sees the program once the commands that built it are complete
+			glFinish();
+
+			lock.lock();
+			reloader.results.push_back(result);
+		}
+
+		glfwMakeContextCurrent(nullptr);
+	}
+}
+
+void createShaderReloader(ShaderReloader& reloader, GLFWwindow* pMainWindow) {
+	createFileWatcher(reloader.watcher, getShaderDirectory());
+
+	// same hints as the main window, only hidden
+	glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+	reloader.pWorkerWindow = glfwCreateWindow(1, 1, "shader reloader", nullptr, pMainWindow);
+	// the hints persist, the next windows are visible again
+	glfwWindowHint(GLFW_VISIBLE, GL_TRUE);
+	if (!reloader.pWorkerWindow) {
+		fprintf(stderr, "Failed to create the shader reloader context, the shaders are reloaded on the main thread\n");
+		return;
+	}
+	reloader.worker = std::thread(runShaderReloaderWorker, &reloader);
+}
+
+void deleteShaderReloader(ShaderReloader& reloader) {
+	if (reloader.worker.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(reloader.mutex);
+			reloader.quit = true;
+		}
+		reloader.jobQueued.notify_one();
+		reloader.worker.join();
+	}
+	if (reloader.pWorkerWindow) {
+		glfwDestroyWindow(reloader.pWorkerWindow);
+		reloader.pWorkerWindow = nullptr;
+	}
+	for (ShaderReloader::Result& result : reloader.results) {
+		deleteShaderProgram(result.newProgram);
+	}
+	reloader.results.clear();
+	reloader.jobs.clear();
+	reloader.jobsInFlight = 0;
+	reloader.reloadRequested = false;
+	deleteFileWatcher(reloader.watcher);
+}
+
+void requestShaderReload(ShaderReloader& reloader) {
+	reloader.reloadRequested = true;
+}
+
+void updateShaderReloader(ShaderReloader& reloader, RenderEngine& engine) {
+	if (pollFileWatcher(reloader.watcher)) {
+		reloader.reloadRequested = true;
+	}
+
+	if (!reloader.worker.joinable()) {
+		if (reloader.reloadRequested) {
+			reloadRenderEngineShaders(engine);
+			reloader.reloadRequested = false;
+		}
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(reloader.mutex);
+	for (ShaderReloader::Result& result : reloader.results) {
+		if (result.newProgram.programId) {
+			replaceRenderEngineShaderProgram(engine, *result.pProgram, result.newProgram);
+		}
+		assert(reloader.jobsInFlight > 0);
+		--reloader.jobsInFlight;
+	}
+	reloader.results.clear();
+
+	// a change during a reload is picked up once it is done, the jobs then compare the files to the programs it installed
+	if (reloader.reloadRequested && reloader.jobsInFlight == 0) {
+		ShaderProgram* programs[RENDER_ENGINE_MAX_PROGRAM_COUNT];
+		const unsigned int programCount = getRenderEngineShaderPrograms(engine, programs);
+		for (unsigned int i = 0; i < programCount; ++i) {
+			ShaderReloader::Job job;
+			job.pProgram = programs[i];
+			job.program = *programs[i];
+			reloader.jobs.push_back(job);
+		}
+		reloader.jobsInFlight = programCount;
+		reloader.reloadRequested = false;
+		lock.unlock();
+		reloader.jobQueued.notify_one();
+	}
+}
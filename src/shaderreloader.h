@@ -0,0 +1,52 @@
+#pragma once
+
+#include "shader.h"
+#include "filewatcher.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct RenderEngine;
+struct GLFWwindow;
+
+// Rebuilds the programs of a render engine when the shader directory changes or when asked, without stalling the frames:
+// only the programs whose sources changed are rebuilt, on a worker thread with a context sharing the objects of the main one.
+// A rebuilt program replaces the old one between two frames, once it is linked; one that fails to link leaves the old one in use.
+// Without the worker context the programs are rebuilt on the main thread
+struct ShaderReloader {
+	struct Job {
+		ShaderProgram* pProgram; // of the engine, only touched by the main thread
+		ShaderProgram program; // copy the worker compares the files to
+	};
+
+	struct Result {
+		ShaderProgram* pProgram;
+		ShaderProgram newProgram; // no programId when nothing has to be replaced
+	};
+
+	FileWatcher watcher;
+	bool reloadRequested = false;
+	unsigned int jobsInFlight = 0; // queued and not collected yet, a new reload waits for them
+
+	GLFWwindow* pWorkerWindow = nullptr; // hidden, holds the context of the worker
+	std::thread worker;
+	std::mutex mutex; // protects the members below
+	std::condition_variable jobQueued;
+	std::vector<Job> jobs;
+	std::vector<Result> results;
+	bool quit = false;
+};
+
+// pMainWindow: window of the context the engine renders with, current on the calling thread
+void createShaderReloader(ShaderReloader& reloader, GLFWwindow* pMainWindow);
+
+// waits for the worker, the programs it built and the engine did not get yet are deleted
+void deleteShaderReloader(ShaderReloader& reloader);
+
+// rebuilds the programs whose files changed, even without a change notification
+void requestShaderReload(ShaderReloader& reloader);
+
+// once per frame, before rendering: starts the reloads and replaces the programs the worker finished
+void updateShaderReloader(ShaderReloader& reloader, RenderEngine& engine);
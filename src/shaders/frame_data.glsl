@@ -0,0 +1,13 @@
+// camera and light of the frame, shared by every program (see FrameUniforms)
+layout(std140, binding = 0) uniform FrameData
+{
+	mat4 View;
+	mat4 Projection;
+	vec3 LightDir; // view space
+	float LightStrength;
+	float Ambient;
+	float Specular;
+	float SpecularPow;
+	float Time; // elapsed time since the beginning of the program
+	vec2 ViewportSize;
+};
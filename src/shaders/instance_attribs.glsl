@@ -0,0 +1,7 @@
+// locations of the 3D vertex and instance attributes (see Buffer3D and InstanceData3D)
+#define BufferAttribVertex 0
+#define BufferAttribNormal 1
+#define BufferAttribColor 2
+#define BufferAttribModel 3 // mat4, uses locations 3 to 6
+#define BufferAttribInstanceColor 7
+#define BufferAttribParams 8
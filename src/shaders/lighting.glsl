@@ -0,0 +1,14 @@
+// Blinn-Phong with the light of the frame (FrameData), n is the unit camera space normal at the camera space position
+vec4 shade(vec3 position, vec3 n, vec4 color)
+{
+	vec3 l = normalize(LightDir);
+	float ndotl =  max(dot(n, l), 0.0);
+	float lightContrib = ndotl * LightStrength;
+	vec3 diffuse = color.xyz;
+
+	vec3 bisect = normalize(normalize(-position) + l);
+	float ndotb = clamp(dot(n, bisect), 0.0, 1.0);
+	float spec = pow(ndotb,SpecularPow) * Specular;
+	vec3 shaded = diffuse * (lightContrib + spec) + diffuse * Ambient ;
+	return vec4(shaded, color.a);
+}
@@ -0,0 +1,47 @@
+// Attribute-less primitives (see eProceduralShape), the vertices are generated from gl_VertexID
+// in the same space as the former CPU tessellation, so that vertex effects see the same positions
+#define ProceduralNone		0
+#define ProceduralSphere	1
+#define ProceduralGrid		2
+#define ProceduralPlane		3
+
+// corners of the two triangles of a quad, in the winding of the tessellated meshes
+const ivec2 SphereQuadCorners[6] = ivec2[6](ivec2(0, 0), ivec2(1, 0), ivec2(1, 1), ivec2(0, 0), ivec2(1, 1), ivec2(0, 1));
+const ivec2 PlaneQuadCorners[6] = ivec2[6](ivec2(0, 0), ivec2(0, 1), ivec2(1, 1), ivec2(0, 0), ivec2(1, 1), ivec2(1, 0));
+
+void proceduralVertex(ivec4 params, inout vec3 position, inout vec3 normal, inout mat4 model)
+{
+	const float PI = 3.14159265359;
+	int shape = params.x;
+	if (shape == ProceduralSphere) {
+		// params.y horizontal and params.z vertical subdivisions, one quad per cell, degenerated at the poles
+		int cell = gl_VertexID / 6;
+		ivec2 corner = SphereQuadCorners[gl_VertexID % 6];
+		int ring = cell / params.y + corner.x;
+		int segment = cell % params.y + corner.y;
+		float verticalAngle = 0.5 * PI - ring * PI / params.z;
+		float horizontalAngle = segment * 2.0 * PI / params.y;
+		vec3 direction = vec3(cos(verticalAngle) * cos(horizontalAngle), sin(verticalAngle), cos(verticalAngle) * sin(horizontalAngle));
+		// the model only places the unit sphere, it is applied here and the sphere is emitted in world space
+		position = vec3(model * vec4(direction, 1.0));
+		normal = normalize(mat3(model) * direction);
+		model = mat4(1.0);
+	}
+	else if (shape == ProceduralGrid) {
+		// params.y + 1 lines along X, then params.y + 1 lines along Z, params.z holds the size bits
+		int line = gl_VertexID / 2;
+		float along = (gl_VertexID % 2) - 0.5;
+		float across = (line % (params.y + 1)) / float(params.y) - 0.5;
+		position = intBitsToFloat(params.z) * (line <= params.y ? vec3(along, 0.0, across) : vec3(across, 0.0, along));
+		normal = vec3(0.0);
+	}
+	else if (shape == ProceduralPlane) {
+		int cell = gl_VertexID / 6;
+		ivec2 corner = PlaneQuadCorners[gl_VertexID % 6];
+		vec2 xz = vec2(cell / params.y + corner.x, cell % params.y + corner.y) / float(params.y) - 0.5;
+		// the model only places the unit plane, it is applied here and the plane is emitted in world space
+		position = vec3(model * vec4(xz.x, 0.0, xz.y, 1.0));
+		normal = vec3(0.0, 1.0, 0.0);
+		model = mat4(1.0);
+	}
+}
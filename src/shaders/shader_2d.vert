@@ -1,9 +1,9 @@
-#version 410 core
+#version 420 core
 
 #define BufferAttribPosition	0
 #define BufferAttribColor		1
 
-uniform vec2 ViewportSize;
+#include "frame_data.glsl"
 
 layout(location = BufferAttribPosition) in vec2 Position;
 layout(location = BufferAttribColor) in vec4 Color;
@@ -1,38 +1,26 @@
-#version 410 core
+#version 420 core
 
-
-uniform vec3 LightDir;
-uniform float LightStrength;
-uniform float Ambient;
-uniform float Specular;
-uniform float SpecularPow;
-
-uniform bool LightingEnabled;
+#include "frame_data.glsl"
+#ifdef SHADER_LIGHTING
+#include "lighting.glsl"
+#endif
 
 layout(location = 0, index = 0) out vec4 FragColor;
 
 in block
 {
 	vec4 Color;
+#ifdef SHADER_LIGHTING
 	vec3 CameraSpacePosition;
 	vec3 CameraSpaceNormal;
+#endif
 } In;
 
 void main()
 {
-	if(LightingEnabled) {
-		vec3 n = normalize(In.CameraSpaceNormal);
-		vec3 l = normalize(LightDir);
-		float ndotl =  max(dot(n, l), 0.0);
-		float lightContrib = ndotl * LightStrength;
-		vec3 diffuse = In.Color.xyz;
-
-		vec3 bisect = normalize(normalize(-In.CameraSpacePosition) + l);
-		float ndotb = clamp(dot(n, bisect), 0.0, 1.0);
-		float spec = pow(ndotb,SpecularPow) * Specular;
-		vec3 color = diffuse * (lightContrib + spec) + diffuse * Ambient ;
-		FragColor = vec4(color, In.Color.a);
-	} else {
-		FragColor = In.Color;
-	}
-}
\ No newline at end of file
+#ifdef SHADER_LIGHTING
+	FragColor = shade(In.CameraSpacePosition, normalize(In.CameraSpaceNormal), In.Color);
+#else
+	FragColor = In.Color;
+#endif
+}
@@ -1,31 +1,45 @@
-#version 410 core
+#version 420 core
 
-#define BufferAttribVertex 0
-#define BufferAttribNormal 1
-#define BufferAttribColor 2
+// permutations (see eShaderPermutation): SHADER_LIGHTING, SHADER_PROCEDURAL
 
-uniform mat4 Model;
-uniform mat4 View;
-uniform mat4 Projection;
+#include "instance_attribs.glsl"
+#include "frame_data.glsl"
 
 layout(location = BufferAttribVertex) in vec3 Position;
 layout(location = BufferAttribNormal) in vec3 Normal;
 layout(location = BufferAttribColor) in vec4 Color;
+layout(location = BufferAttribModel) in mat4 Model; // per instance
+layout(location = BufferAttribInstanceColor) in vec4 InstanceColor; // per instance
+layout(location = BufferAttribParams) in ivec4 Params; // per instance, procedural shape and subdivisions, w unused
 
 out block
 {
 	vec4 Color;
+#ifdef SHADER_LIGHTING
 	vec3 CameraSpacePosition;
 	vec3 CameraSpaceNormal;
+#endif
 } Out;
 
+#ifdef SHADER_PROCEDURAL
+#include "procedural_vertex.glsl"
+#endif
+
 void main()
 {
-	mat4 MV = View * Model;
-	vec4 p = vec4(Position, 1.0);
-	vec4 n = vec4(Normal, 0.0);
+	vec3 position = Position;
+	vec3 normal = Normal;
+	mat4 model = Model;
+#ifdef SHADER_PROCEDURAL
+	proceduralVertex(Params, position, normal, model);
+#endif
+
+	mat4 MV = View * model;
+	vec4 p = vec4(position, 1.0);
 	gl_Position = Projection * MV * p;
-	Out.Color = Color;
+	Out.Color = Color * InstanceColor;
+#ifdef SHADER_LIGHTING
 	Out.CameraSpacePosition = vec3(MV * p);
-	Out.CameraSpaceNormal = vec3(MV * n);
-}
\ No newline at end of file
+	Out.CameraSpaceNormal = vec3(MV * vec4(normal, 0.0));
+#endif
+}
@@ -2,23 +2,21 @@
 
 // You can compil and refresh the shader at runtime using the F7 key
 
-#define BufferAttribVertex 0
-#define BufferAttribNormal 1
-#define BufferAttribColor 2
+#include "instance_attribs.glsl"
 
+//-- Uniform are variable that are common to all vertices of the drawcall, here the block of the frame shared by every program
+#include "frame_data.glsl"
 
-//-- Uniform are variable that are common to all vertices of the drawcall
-uniform mat4 Model; // Model matrix
-uniform mat4 View;  // View matrix
-uniform mat4 Projection; // Projection Matrix
-uniform float Time; // Elapsed time since the begining of the program
-
-//-- attributes can change for each vertex
+//-- attributes can change for each vertex (or for each instance)
 layout(location = BufferAttribVertex) in vec3 Position; // Position of current vertex
 layout(location = BufferAttribNormal) in vec3 Normal;		// Normal of current vertex
 layout(location = BufferAttribColor) in vec4 Color;			// Color of current vertex
+layout(location = BufferAttribModel) in mat4 Model; // Model matrix of current instance
+layout(location = BufferAttribInstanceColor) in vec4 InstanceColor;	// Color of current instance
+layout(location = BufferAttribParams) in ivec4 Params;	// Shape generated from gl_VertexID (solidSphere, grid, horizontalPlane), 0 otherwise, w unused
 
 //-- Here is the GPU counterpart of the VertexShaderAdditionalData structure
+// the payload can be much larger, end the block with an unsized array to send thousands of values (e.g. mat4 Bones[];)
 layout(std430, binding= 3) buffer bufferData
 { 
 	vec3 center;
@@ -27,24 +25,40 @@ layout(std430, binding= 3) buffer bufferData
 out block //define the additional output that will be received by the fragment shader
 {
 	vec4 Color;
+#ifdef SHADER_LIGHTING
 	vec3 CameraSpacePosition;
 	vec3 CameraSpaceNormal;
+#endif
 } Out;
 
+// defined for the draws of solidSphere, grid and horizontalPlane only (see eShaderPermutation)
+#ifdef SHADER_PROCEDURAL
+#include "procedural_vertex.glsl"
+#endif
+
 void main()
 {
-	mat4 MV = View * Model;
+	vec3 position = Position;
+	vec3 normal = Normal;
+	mat4 model = Model;
+#ifdef SHADER_PROCEDURAL
+	proceduralVertex(Params, position, normal, model);
+#endif
+
+	mat4 MV = View * model;
 	
-	float XParity = mod(3.*Position.x + Time, 2.0f);
+	float XParity = mod(3.*position.x + Time, 2.0f);
 	XParity = step(XParity, 0.2f);
-	vec4 NewPos = vec4(Position, 1);
+	vec4 NewPos = vec4(position, 1);
 	NewPos.x += Data.center.x;
 	NewPos.y += XParity * 0.25 + Data.center.y;
 	NewPos.z += Data.center.z;
 
+#ifdef SHADER_LIGHTING // defined for the lit draws
 	Out.CameraSpacePosition = vec3(MV * NewPos);
-	Out.CameraSpaceNormal = vec3(MV * vec4(Normal, 0.0f));
-	Out.Color = Color;
+	Out.CameraSpaceNormal = vec3(MV * vec4(normal, 0.0f));
+#endif
+	Out.Color = Color * InstanceColor;
 	Out.Color.r = (sin(Time) + 1.0f)*0.5f;
 	//gl_position is always an output and is the resulting vertex pos that will be feeded to fragment shader
 	gl_Position = Projection * MV * NewPos;
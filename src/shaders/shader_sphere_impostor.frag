@@ -0,0 +1,39 @@
+#version 420 core
+
+#include "frame_data.glsl"
+#ifdef SHADER_LIGHTING
+#include "lighting.glsl"
+#endif
+
+layout(location = 0, index = 0) out vec4 FragColor;
+
+in block
+{
+	vec4 Color;
+	vec3 CameraSpacePosition;
+	flat vec3 CameraSpaceCenter;
+	flat float Radius;
+} In;
+
+void main()
+{
+	// view ray from the camera (origin of the camera space) through the quad
+	vec3 dir = normalize(In.CameraSpacePosition);
+	vec3 center = In.CameraSpaceCenter;
+	float b = dot(dir, center);
+	float h = b * b - (dot(center, center) - In.Radius * In.Radius);
+	if (h < 0.0) {
+		discard;
+	}
+
+	// closest hit, its depth replaces the depth of the quad
+	vec3 position = (b - sqrt(h)) * dir;
+	vec4 clipPosition = Projection * vec4(position, 1.0);
+	gl_FragDepth = 0.5 * (clipPosition.z / clipPosition.w) + 0.5;
+
+#ifdef SHADER_LIGHTING
+	FragColor = shade(position, (position - center) / In.Radius, In.Color);
+#else
+	FragColor = In.Color;
+#endif
+}
@@ -0,0 +1,44 @@
+#version 420 core
+
+// Sphere impostors: one camera facing quad per instance (4 vertices, triangle strip, no vertex stream),
+// the fragment shader intersects the view ray with the sphere. permutation: SHADER_LIGHTING
+
+#include "instance_attribs.glsl"
+#include "frame_data.glsl"
+
+layout(location = BufferAttribModel) in mat4 Model; // per instance, the translation is the center and the scale the radius
+layout(location = BufferAttribInstanceColor) in vec4 InstanceColor; // per instance
+layout(location = BufferAttribParams) in ivec4 Params; // per instance, w unused
+
+out block
+{
+	vec4 Color;
+	vec3 CameraSpacePosition;
+	flat vec3 CameraSpaceCenter;
+	flat float Radius;
+} Out;
+
+void main()
+{
+	vec3 center = vec3(View * Model[3]);
+	float radius = length(Model[0].xyz);
+
+	// the quad is perpendicular to the direction of the center, its half size is the radius
+	// of the silhouette cone in that plane (the camera inside the sphere collapses the quad)
+	float distance2 = dot(center, center);
+	float radius2 = radius * radius;
+	float halfSize = distance2 > radius2 ? radius * sqrt(distance2 / (distance2 - radius2)) : 0.0;
+
+	vec3 axis = center * inversesqrt(distance2);
+	vec3 right = normalize(cross(abs(axis.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0), axis));
+	vec3 up = cross(axis, right);
+
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+	vec3 p = center + halfSize * (corner.x * right + corner.y * up);
+
+	gl_Position = Projection * vec4(p, 1.0);
+	Out.Color = InstanceColor;
+	Out.CameraSpacePosition = p;
+	Out.CameraSpaceCenter = center;
+	Out.Radius = radius;
+}
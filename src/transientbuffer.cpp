@@ -0,0 +1,85 @@
+#include "transientbuffer.h"
+#include "mappedbuffer.h"
+
+#include <assert.h>
+
+bool createTransientBuffer(TransientBuffer& transientBuffer, GLsizeiptr frameCapacity) {
+	assert(transientBuffer.buffer == 0); // trying to create a buffer already initialized
+	transientBuffer.frameOffset = 0;
+	transientBuffer.frameIndex = 0;
+	transientBuffer.overflowCount = 0;
+	for (GLsync& fence : transientBuffer.fences) {
+		fence = nullptr;
+	}
+	if (!createMappedStorage(frameCapacity * TransientBuffer::FRAMES_IN_FLIGHT, transientBuffer.buffer, transientBuffer.pMapped)) {
+		return false;
+	}
+	transientBuffer.frameCapacity = frameCapacity;
+	return true;
+}
+
+void deleteTransientBuffer(TransientBuffer& transientBuffer) {
+	for (GLsync& fence : transientBuffer.fences) {
+		waitFence(fence);
+	}
+	deleteMappedStorage(transientBuffer.buffer, transientBuffer.pMapped);
+}
+
+void beginTransientBufferFrame(TransientBuffer& transientBuffer) {
+	transientBuffer.frameIndex = (transientBuffer.frameIndex + 1) % TransientBuffer::FRAMES_IN_FLIGHT;
+	transientBuffer.frameOffset = 0;
+	waitFence(transientBuffer.fences[transientBuffer.frameIndex]);
+}
+
+void endTransientBufferFrame(TransientBuffer& transientBuffer) {
+	GLsync& fence = transientBuffer.fences[transientBuffer.frameIndex];
+	assert(!fence);
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool transientBufferHasRoom(const TransientBuffer& transientBuffer, GLsizeiptr size, GLsizeiptr alignment) {
+	const GLsizeiptr regionStart = transientBuffer.frameIndex * transientBuffer.frameCapacity;
+	const GLsizeiptr alignedOffset = ((regionStart + transientBuffer.frameOffset + alignment - 1) / alignment) * alignment;
+	return alignedOffset + size <= regionStart + transientBuffer.frameCapacity;
+}
+
+void* allocateTransient(TransientBuffer& transientBuffer, GLsizeiptr size, GLsizeiptr alignment, GLintptr& offset) {
+	const GLsizeiptr regionStart = transientBuffer.frameIndex * transientBuffer.frameCapacity;
+	GLsizeiptr alignedOffset = ((regionStart + transientBuffer.frameOffset + alignment - 1) / alignment) * alignment;
+
+	if (!transientBufferHasRoom(transientBuffer, size, alignment)) {
+		// out of space: wait until the GPU consumed everything and restart at the beginning of the region
+		++transientBuffer.overflowCount;
+		glFinish();
+		for (GLsync& fence : transientBuffer.fences) {
+			if (fence) {
+				glDeleteSync(fence);
+				fence = nullptr;
+			}
+		}
+
+		if (size + alignment > transientBuffer.frameCapacity) {
+			GLsizeiptr newFrameCapacity = 2 * transientBuffer.frameCapacity;
+			while (size + alignment > newFrameCapacity) {
+				newFrameCapacity *= 2;
+			}
+			// the old storage stays usable for the smaller requests when the new one cannot be created
+			GLuint oldBuffer = transientBuffer.buffer;
+			char* pOldMapped = transientBuffer.pMapped;
+			if (!createMappedStorage(newFrameCapacity * TransientBuffer::FRAMES_IN_FLIGHT, transientBuffer.buffer, transientBuffer.pMapped)) {
+				offset = 0;
+				return nullptr;
+			}
+			deleteMappedStorage(oldBuffer, pOldMapped);
+			transientBuffer.frameCapacity = newFrameCapacity;
+		}
+
+		const GLsizeiptr newRegionStart = transientBuffer.frameIndex * transientBuffer.frameCapacity;
+		alignedOffset = ((newRegionStart + alignment - 1) / alignment) * alignment;
+	}
+
+	const GLsizeiptr currentRegionStart = transientBuffer.frameIndex * transientBuffer.frameCapacity;
+	transientBuffer.frameOffset = alignedOffset + size - currentRegionStart;
+	offset = alignedOffset;
+	return transientBuffer.pMapped + alignedOffset;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <glad.h>
+
+// Persistently mapped streaming buffer, split in one region per frame in flight.
+// Data written during a frame stays valid until the GPU is done with that frame,
+// a fence per region prevents overwriting data the GPU has not consumed yet.
+struct TransientBuffer {
+	enum { FRAMES_IN_FLIGHT = 3 };
+
+	GLuint buffer = 0;
+	char* pMapped = nullptr;
+
+	GLsizeiptr frameCapacity = 0; // size in bytes of one region
+	GLsizeiptr frameOffset = 0; // write offset inside the current region
+	unsigned int frameIndex = 0;
+	GLsync fences[FRAMES_IN_FLIGHT] = {};
+
+	unsigned int overflowCount = 0; // number of times a frame ran out of space and had to wait for the GPU
+};
+
+bool createTransientBuffer(TransientBuffer& transientBuffer, GLsizeiptr frameCapacity);
+
+void deleteTransientBuffer(TransientBuffer& transientBuffer);
+
+// waits until the GPU released the region of the new frame
+void beginTransientBufferFrame(TransientBuffer& transientBuffer);
+
+// fences the region written during the frame
+void endTransientBufferFrame(TransientBuffer& transientBuffer);
+
+// true when allocateTransient can serve the request without waiting for the GPU
+bool transientBufferHasRoom(const TransientBuffer& transientBuffer, GLsizeiptr size, GLsizeiptr alignment);
+
+// returns a write pointer into the mapped storage and the matching offset from the start of the GL buffer.
+// offset is a multiple of alignment (which does not need to be a power of two, vertex strides are fine).
+// warning: when the region is full this waits for the GPU, everything written before must have been submitted.
+// nullptr when the request needs a larger storage that cannot be created, the current storage is kept
+void* allocateTransient(TransientBuffer& transientBuffer, GLsizeiptr size, GLsizeiptr alignment, GLintptr& offset);
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <glad.h>
+
+#include <initializer_list>
+#include <tuple>
+#include <string.h>
+
+// Compile time description of the vertices of a buffer: which attributes, their GPU format and their place in memory.
+// The layout computes sizes and offsets, declares the formats on a vertex array (DSA) and writes vertices in a CPU copy.
+
+enum class eVertexLayout {
+	Interleaved, // one binding, the attributes of a vertex are contiguous
+	Separate, // one binding per attribute, each attribute is a contiguous array (SoA) in the same buffer
+};
+
+// Storage is the type written in the buffer, the shader reads componentCount components of componentType
+template <GLuint Location, typename StorageType, GLint ComponentCount, GLenum ComponentType, GLboolean Normalized = GL_FALSE>
+struct VertexAttrib {
+	using Storage = StorageType;
+	static constexpr GLuint location = Location;
+	static constexpr GLint componentCount = ComponentCount;
+	static constexpr GLenum componentType = ComponentType;
+	static constexpr GLboolean normalized = Normalized;
+};
+
+namespace vertexlayout_detail {
+	constexpr GLsizei sumSizes(std::initializer_list<GLsizei> sizes, GLuint count) {
+		GLsizei sum = 0;
+		GLuint i = 0;
+		for (GLsizei size : sizes) {
+			if (i++ == count) {
+				break;
+			}
+			sum += size;
+		}
+		return sum;
+	}
+}
+
+template <eVertexLayout Layout, typename... Attribs>
+struct VertexLayout {
+	static_assert(sizeof...(Attribs) > 0, "a vertex layout needs at least one attribute");
+
+	static constexpr GLuint attribCount = sizeof...(Attribs);
+	static constexpr GLsizei vertexSize = vertexlayout_detail::sumSizes({ GLsizei(sizeof(typename Attribs::Storage))... }, sizeof...(Attribs));
+
+	template <GLuint I>
+	using Attrib = typename std::tuple_element<I, std::tuple<Attribs...>>::type;
+
+	static constexpr GLsizei attribSize(GLuint index) {
+		return vertexlayout_detail::sumSizes({ GLsizei(sizeof(typename Attribs::Storage))... }, index + 1) - attribOffset(index);
+	}
+
+	// offset inside a vertex when interleaved, the same value times the vertex count is the offset of the array when separate
+	static constexpr GLsizei attribOffset(GLuint index) {
+		return vertexlayout_detail::sumSizes({ GLsizei(sizeof(typename Attribs::Storage))... }, index);
+	}
+
+	static constexpr GLsizeiptr bufferSize(GLsizei vertexCount) {
+		return GLsizeiptr(vertexCount) * vertexSize;
+	}
+
+	// declares the attribute formats on vao, the vertices come from firstBinding (interleaved) or firstBinding + attribute index (separate)
+	static void setupFormat(GLuint vao, GLuint firstBinding = 0) {
+		const GLuint locations[] = { Attribs::location... };
+		const GLint componentCounts[] = { Attribs::componentCount... };
+		const GLenum componentTypes[] = { Attribs::componentType... };
+		const GLboolean normalized[] = { Attribs::normalized... };
+		for (GLuint i = 0; i < attribCount; ++i) {
+			const bool interleaved = Layout == eVertexLayout::Interleaved;
+			glEnableVertexArrayAttrib(vao, locations[i]);
+			glVertexArrayAttribFormat(vao, locations[i], componentCounts[i], componentTypes[i], normalized[i], interleaved ? attribOffset(i) : 0);
+			glVertexArrayAttribBinding(vao, locations[i], interleaved ? firstBinding : firstBinding + i);
+		}
+	}
+
+	// binds the vertices stored at offset in buffer, the arrays of a separate layout hold vertexCount elements each
+	static void bindBuffer(GLuint vao, GLuint buffer, GLintptr offset, GLsizei vertexCount, GLuint firstBinding = 0) {
+		if (Layout == eVertexLayout::Interleaved) {
+			glVertexArrayVertexBuffer(vao, firstBinding, buffer, offset, vertexSize);
+			return;
+		}
+		for (GLuint i = 0; i < attribCount; ++i) {
+			glVertexArrayVertexBuffer(vao, firstBinding + i, buffer, offset + GLintptr(vertexCount) * attribOffset(i), attribSize(i));
+		}
+	}
+
+	// writes attribute I of vertex iVertex in a copy of the vertices of bufferSize(vertexCount) bytes
+	template <GLuint I>
+	static void write(void* pVertices, GLsizei vertexCount, GLsizei iVertex, const typename Attrib<I>::Storage& value) {
+		const GLintptr offset = Layout == eVertexLayout::Interleaved
+			? GLintptr(iVertex) * vertexSize + attribOffset(I)
+			: GLintptr(vertexCount) * attribOffset(I) + GLintptr(iVertex) * attribSize(I);
+		// no alignment requirement on the destination
+		memcpy((char*)pVertices + offset, &value, sizeof(value));
+	}
+};
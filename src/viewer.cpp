@@ -5,9 +5,11 @@
 #include "shader.h"
 #include "drawbuffer.h"
 #include "renderengine.h"
+#include "framereadback.h"
+#include "shaderreloader.h"
 #include "camera.h"
 
-#include <time.h>
+#include <math.h>
 
 #include <GLFW/glfw3.h>
 #include <glad.h>
@@ -82,6 +84,7 @@ namespace {
 		bool zoomLock;
 		int lockPositionX;
 		int lockPositionY;
+		bool reloadKeyDown; // F7 during the previous frame, a reload starts when it goes down
 
 		static constexpr float GUIStates::MOUSE_PAN_SPEED = 0.001f;
 		static constexpr float GUIStates::MOUSE_ZOOM_SPEED = 0.005f;
@@ -95,6 +98,7 @@ namespace {
 		guiStates.zoomLock = false;
 		guiStates.lockPositionX = 0;
 		guiStates.lockPositionY = 0;
+		guiStates.reloadKeyDown = false;
 	}
 
 	void render3DCallback(const RenderApi3D& api, void* pUserData) {
@@ -102,6 +106,11 @@ namespace {
 		viewer.render3D(api);
 	}
 
+	void render3DStaticCallback(const RenderApi3D& api, void* pUserData) {
+		const Viewer& viewer = *reinterpret_cast<Viewer const*>(pUserData);
+		viewer.renderStatic3D(api);
+	}
+
 	void render3DCustomCallback(const RenderApi3D& api, void* pUserData) {
 		const Viewer& viewer = *reinterpret_cast<Viewer const*>(pUserData);
 		viewer.render3D_custom(api);
@@ -110,6 +119,41 @@ namespace {
 		const Viewer& viewer = *reinterpret_cast<Viewer const*>(pUserData);
 		viewer.render2D(api);
 	}
+
+	// cpuTimeMs: time spent by the previous frame before the swap (update, recording and submission of the draws, GUI)
+	void drawRenderEngineGUI(Viewer& viewer, const RenderEngine& renderEngine, float cpuTimeMs) {
+		BufferArenaStats arenaStats;
+		getBufferArenaStats(renderEngine.bufferArena, arenaStats);
+
+		ImGui::Begin("Render engine");
+		ImGui::SliderFloat("Frame time budget (ms)", &viewer.frameTimeBudgetMs, 0.f, 100.f);
+		const int sampleCounts[] = { 1, 2, 4, 8 };
+		const char* sampleCountNames[] = { "Off", "2x", "4x", "8x" };
+		int iSampleCount = 0;
+		while (iSampleCount < 3 && sampleCounts[iSampleCount] < viewer.msaaSamples) {
+			++iSampleCount;
+		}
+		if (ImGui::Combo("MSAA", &iSampleCount, sampleCountNames, COUNTOF(sampleCountNames))) {
+			viewer.msaaSamples = sampleCounts[iSampleCount];
+		}
+		ImGui::Text("3D resolution scale %.2f", renderEngine.dynamicResolution.scale);
+		ImGui::Separator();
+
+		const char* sectionNames[GpuTimerSectionCount] = { "3D", "Upscale", "2D", "ImGui" };
+		float gpuTimeMs = 0.f;
+		for (unsigned int section = 0; section < GpuTimerSectionCount; ++section) {
+			ImGui::Text("GPU %s: %.3f ms", sectionNames[section], renderEngine.gpuTimer.sectionMs[section]);
+			gpuTimeMs += renderEngine.gpuTimer.sectionMs[section];
+		}
+		ImGui::Text("GPU total %.3f ms, CPU %.3f ms: %s bound", gpuTimeMs, cpuTimeMs, gpuTimeMs > cpuTimeMs ? "GPU" : "CPU");
+		ImGui::Text("GL state calls %u, redundant skipped %u", renderEngine.glState.callCount, renderEngine.glState.elidedCount);
+		ImGui::Separator();
+		ImGui::Text("Buffer arena: %u blocks, %u allocations", arenaStats.blockCount, arenaStats.allocationCount);
+		ImGui::Text("In use %.1f KB / %.1f KB", arenaStats.bytesInUse / 1024.f, arenaStats.capacity / 1024.f);
+		ImGui::Text("Free %.1f KB in %u ranges, largest %.1f KB", arenaStats.freeBytes / 1024.f, arenaStats.freeRangeCount, arenaStats.largestFreeRange / 1024.f);
+		ImGui::Text("Fragmentation %.1f %%", arenaStats.fragmentation * 100.f);
+		ImGui::End();
+	}
 }
 
 Viewer::Viewer(char const* initialWindowName, int initialViewportWidth, int initialViewportHeight) {
@@ -130,10 +174,17 @@ Viewer::Viewer(char const* initialWindowName, int initialViewportWidth, int init
 	viewportWidth = initialViewportWidth;
 	viewportHeight = initialViewportHeight;
 
+	frameTimeBudgetMs = 1000.f / 30.f;
+	msaaSamples = 1;
+
 	window = nullptr;
 
 	pCustomShaderData = nullptr;
 	CustomShaderDataSize = 0;
+
+	simulationStep = 1.0 / 60.0;
+	maxSimulationSteps = 8;
+	simulationAlpha = 0.f;
 }
 
 namespace {
@@ -145,6 +196,15 @@ namespace {
 }
 
 int /*exit code*/ Viewer::run() {
+	return runLoop(nullptr);
+}
+
+int /*exit code*/ Viewer::runHeadless(const HeadlessParams& params) {
+	return runLoop(&params);
+}
+
+int /*exit code*/ Viewer::runLoop(const HeadlessParams* pHeadless) {
+	const bool headless = pHeadless != nullptr;
 
 	// Initialize glfw library
 	if (!glfwInit()) {
@@ -161,7 +221,8 @@ int /*exit code*/ Viewer::run() {
   return -1;
 
 	glfwWindowHint(GLFW_RESIZABLE, GL_TRUE);
-	glfwWindowHint(GLFW_VISIBLE, GL_TRUE);
+	// glfw 3.3 always needs a window for the context, a headless run hides it and never presents it
+	glfwWindowHint(GLFW_VISIBLE, headless ? GL_FALSE : GL_TRUE);
 	glfwWindowHint(GLFW_DECORATED, GL_TRUE);
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_OPENGL_API);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
@@ -192,6 +253,7 @@ int /*exit code*/ Viewer::run() {
 	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
 		ERROR("Failed to initialize OpenGL context.");
 	}
+	const bool parallelShaderCompile = enableParallelShaderCompile((GLADloadproc)glfwGetProcAddress);
 
 	// Ensure we can capture the escape key being pressed below
 	glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
@@ -231,20 +293,56 @@ int /*exit code*/ Viewer::run() {
 	// call virtual method
 	init();
 
+	captureStaticBatch3D(renderEngine, render3DStaticCallback, this);
+
+	// the shader files are watched by interactive runs only
+	ShaderReloader shaderReloader;
+	if (!headless) {
+		createShaderReloader(shaderReloader, window);
+	}
+
+	// a headless run renders in its own framebuffer, the default one of a hidden window may not even be backed
+	RenderTarget headlessTarget;
+	FrameReadback headlessReadback;
+	if (headless) {
+		if (!createRenderTarget(headlessTarget, viewportWidth, viewportHeight, 1)) {
+			ERROR("Failed to create headless render target");
+		}
+		if (pHeadless->readbackCallback) {
+			createFrameReadback(headlessReadback, viewportWidth, viewportHeight);
+		}
+	}
+
 	if (checkOpenGlError()) {
 		ERROR("OpenGL Error before launching main loop");
 	}
 
-	const clock_t startTime = clock();
+	float frameTimeMs = 0.f;
+	float cpuTimeMs = 0.f;
+	unsigned int frameIndex = 0;
+	bool firstCompleteFrameReported = false;
+	const double firstFrameTime = glfwGetTime();
+
+	// the first frame shows the initial state
+	double simulationTime = 0.0;
+	double simulationLag = 0.0; // wall time not simulated yet
+	double previousFrameStart = firstFrameTime;
+	simulationAlpha = 0.f;
+	update(simulationTime);
 
 	// Loop until the user closes the window
-	while (!glfwWindowShouldClose(window) && (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS)) {
+	while (headless
+		? frameIndex < pHeadless->frameCount
+		: !glfwWindowShouldClose(window) && (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS)) {
 		t = glfwGetTime();
 
 		// Poll for and process events
 		glfwPollEvents();
 
-		glfwGetFramebufferSize(window, &viewportWidth, &viewportHeight);
+		// the headless size is the one of its render target
+		if (!headless) {
+			glfwGetFramebufferSize(window, &viewportWidth, &viewportHeight);
+		}
 
 		// Mouse states
 		int leftButton = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT);
@@ -311,18 +409,37 @@ int /*exit code*/ Viewer::run() {
 			guiStates.lockPositionY = mousey;
 		}
 
-		if (f7Pressed) {
-			reloadRenderEngineShaders(renderEngine);
+		const bool reloadKeyDown = f7Pressed == GLFW_PRESS;
+		if (reloadKeyDown && !guiStates.reloadKeyDown) {
+			requestShaderReload(shaderReloader);
 		}
-
-		const clock_t currentTime = clock();
-		const double elapsedTime = (currentTime - startTime) / double(CLOCKS_PER_SEC);
-		update(elapsedTime);
+		guiStates.reloadKeyDown = reloadKeyDown;
+		updateShaderReloader(shaderReloader, renderEngine);
+
+		beginFrame();
+
+		// a headless run takes one step per frame, its captures do not depend on how fast the machine renders
+		simulationLag += headless ? simulationStep : t - previousFrameStart;
+		previousFrameStart = t;
+		unsigned int stepCount = 0;
+		while (simulationLag >= simulationStep && stepCount < maxSimulationSteps) {
+			simulationTime += simulationStep;
+			update(simulationTime);
+			simulationLag -= simulationStep;
+			++stepCount;
+		}
+		if (simulationLag >= simulationStep) {
+			simulationLag = fmod(simulationLag, simulationStep);
+		}
+		simulationAlpha = float(simulationLag / simulationStep);
 
 		RenderParams renderParams;
 		renderParams.render3DCallback = render3DCallback;
 		renderParams.pRender3DCallbackUserData = this;
 
+		renderParams.render3DStaticCallback = render3DStaticCallback;
+		renderParams.pRender3DStaticCallbackUserData = this;
+
 		renderParams.render3DCustomCallback = render3DCustomCallback;
 		renderParams.pRender3DCustomCallbackUserData = this;
 
@@ -346,41 +463,89 @@ int /*exit code*/ Viewer::run() {
 		renderParams.viewportWidth = viewportWidth;
 		renderParams.viewportHeight = viewportHeight;
 
+		// nobody watches a headless run, its frames keep the full resolution
+		renderParams.targetFramebuffer = headless ? headlessTarget.fbo : 0;
+		renderParams.frameTimeBudgetMs = headless ? 0.f : frameTimeBudgetMs;
+		renderParams.frameTimeMs = frameTimeMs;
+		renderParams.msaaSamples = msaaSamples;
+		// the captures of a headless run must not miss the draws of programs still building
+		renderParams.waitForShaders = headless;
+
 		renderParams.time = (float)t;
 		renderParams.pCustomVertShaderData = pCustomShaderData;
 		renderParams.CustomVertShaderDataSize = CustomShaderDataSize;
 
 		renderEngineFrame(renderEngine, renderParams);
 
-		// Start the Dear ImGui frame
-		ImGui_ImplOpenGL3_NewFrame();
-		ImGui_ImplGlfw_NewFrame();
-		ImGui::NewFrame();
-
-		drawGUI();
+		if (headless) {
+			if (pHeadless->readbackCallback) {
+				queueFrameReadback(headlessReadback, headlessTarget.fbo, frameIndex, pHeadless->readbackCallback, pHeadless->pReadbackUserData);
+			}
+		}
+		else {
+			// Start the Dear ImGui frame
+			ImGui_ImplOpenGL3_NewFrame();
+			ImGui_ImplGlfw_NewFrame();
+			ImGui::NewFrame();
+
+			drawGUI();
+			drawRenderEngineGUI(*this, renderEngine, cpuTimeMs);
+
+			// Rendering
+			ImGui::Render();
+			glViewport(0, 0, viewportWidth, viewportHeight);
+			//glClear(GL_COLOR_BUFFER_BIT);
+			beginGpuTimerSection(renderEngine.gpuTimer, GpuTimerSectionImGui);
+			ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+			endGpuTimerSection(renderEngine.gpuTimer, GpuTimerSectionImGui);
+		}
 
-		// Rendering
-		ImGui::Render();
-		glViewport(0, 0, viewportWidth, viewportHeight);
-		//glClear(GL_COLOR_BUFFER_BIT);
-		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+		cpuTimeMs = float((glfwGetTime() - t) * 1000.0);
+		++frameIndex;
 
 		// Swap front and back buffers
-		glfwSwapBuffers(window);
+		if (!headless) {
+			glfwSwapBuffers(window);
+		}
 
 		if (checkOpenGlError()) {
 			assert(false);
 		}
 
+		// from glfwInit to the first frame that skipped no draw for a program still building, waits for the GPU once so that
+		// the shader builds the driver still runs are counted
+		if (!firstCompleteFrameReported && renderEngine.skippedDrawCount == 0) {
+			firstCompleteFrameReported = true;
+			glFinish();
+			printf("%s: first complete frame (%u) after %.1f ms, parallel shader compile %s\n", windowName, frameIndex, glfwGetTime() * 1000.0,
+				parallelShaderCompile ? "on" : "off");
+		}
+
 		double newTime = glfwGetTime();
 		fps = 1.0 / (newTime - t);
+		frameTimeMs = float((newTime - t) * 1000.0);
 
-		char windowNameEx[COUNTOF(windowName) * 2];
-		sprintf(windowNameEx, "%s - %.0f fps", windowName, fps);
-		glfwSetWindowTitle(window, windowNameEx);
+		if (!headless) {
+			char windowNameEx[COUNTOF(windowName) * 2];
+			sprintf(windowNameEx, "%s - %.0f fps", windowName, fps);
+			glfwSetWindowTitle(window, windowNameEx);
+		}
+	}
+
+	if (headless) {
+		collectFrameReadbacks(headlessReadback, true, pHeadless->readbackCallback, pHeadless->pReadbackUserData);
+		glFinish();
+		const double totalTime = glfwGetTime() - firstFrameTime;
+		printf("%s: %u frames of %dx%d in %.3f s, %.3f ms per frame\n", windowName, frameIndex, viewportWidth, viewportHeight,
+			totalTime, frameIndex ? totalTime * 1000.0 / frameIndex : 0.0);
 	}
 
 	// Cleanup
+	deleteShaderReloader(shaderReloader);
+	deleteFrameReadback(headlessReadback);
+	deleteRenderTarget(headlessTarget);
+	deleteRenderEngine(renderEngine);
+
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplGlfw_Shutdown();
 	ImGui::DestroyContext();
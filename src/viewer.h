@@ -7,6 +7,14 @@ struct RenderApi3D;
 struct RenderApi2D;
 struct GLFWwindow;
 
+// see Viewer::runHeadless
+struct HeadlessParams {
+	unsigned int frameCount = 100;
+	// called with every frame (RGBA8, bottom row first) a few frames after it was rendered, nullptr skips the readback
+	void (*readbackCallback)(unsigned int frameIndex, const unsigned char* pPixels, int width, int height, void* pUserData) = nullptr;
+	void* pReadbackUserData = nullptr;
+};
+
 struct Viewer {
 	char windowName[512];
 	GLFWwindow* window;
@@ -27,14 +35,32 @@ struct Viewer {
 	int viewportWidth;
 	int viewportHeight;
 
+	// the 3D resolution drops while the frame time is above the budget (0 keeps the full resolution), see RenderParams
+	float frameTimeBudgetMs;
+	int msaaSamples;
+
 	void* pCustomShaderData;
 	int CustomShaderDataSize;
 
+	// update() runs at a fixed rate whatever the display rate: the wall time of a frame is consumed by steps of simulationStep seconds,
+	// at most maxSimulationSteps per frame. the time left after that is dropped, a slow frame slows the simulation down instead of
+	// scheduling more steps for the next ones
+	double simulationStep;
+	unsigned int maxSimulationSteps;
+	// fraction of a step the wall time is ahead of the last update(), in [0, 1): the render functions can interpolate from the previous state
+	float simulationAlpha;
+
 
 	Viewer(char const* initialWindowName, int initialViewportWidth, int initialViewportHeight);
 
 	int /*exit code*/ run();
 
+	// no visible window, input nor GUI: renders frameCount frames of viewportWidth x viewportHeight in an offscreen framebuffer
+	// as fast as it can (benchmarks, captures, machines without a display server such as CI with Mesa llvmpipe)
+	int /*exit code*/ runHeadless(const HeadlessParams& params);
+
+	int /*exit code*/ runLoop(const HeadlessParams* pHeadless);
+
 	// -----------------------------------
 	// override the following functions
 	// to create your own viewer
@@ -42,10 +68,19 @@ struct Viewer {
 
 	virtual void init() = 0;
 
+	// once per frame before its simulation steps: input and the state of the frame (pCustomShaderData...)
+	virtual void beginFrame() {}
+
+	// one step of simulationStep seconds, elapsedTime is the simulation time at the end of the step (0 for the call before the first frame).
+	// a frame takes from 0 to maxSimulationSteps of them
 	virtual void update(double elapsedTime) = 0;
 
 	virtual void render3D_custom(const RenderApi3D& api) const = 0;
 
+	// called once after init(), the draws are kept by the engine and replayed every frame.
+	// only for opaque content that never changes, buffers given to api.buffer() must outlive the viewer
+	virtual void renderStatic3D(const RenderApi3D& api) const {}
+
 	virtual void render3D(const RenderApi3D& api) const = 0;
 
 	virtual void render2D(const RenderApi2D& api) const = 0;